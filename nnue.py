@@ -0,0 +1,57 @@
+import argparse, struct
+
+# Add a Pali network header to a raw quantised network
+# Layout must match NetworkHeader in src/nnue/Network.h
+
+parser = argparse.ArgumentParser()
+parser.add_argument("input", help="raw network from the trainer")
+parser.add_argument("output")
+parser.add_argument("--input-size", type=int, default=768)
+parser.add_argument("--hidden-size", type=int, default=256)
+parser.add_argument("--input-buckets", type=int, default=1)
+parser.add_argument("--mirrored", action="store_true")
+parser.add_argument("--output-buckets", type=int, default=1)
+parser.add_argument("--l2-size", type=int, default=0, help="0 without dense layers")
+parser.add_argument("--l3-size", type=int, default=0)
+args = parser.parse_args()
+
+MAGIC = b"PALINNUE"
+VERSION = 3
+
+payload = open(args.input, "rb").read()
+
+# Networks are padded to 64 bytes so the weights stay aligned
+payload += bytes(-len(payload) % 64)
+
+
+def fnv1a(data):
+    h = 0xCBF29CE484222325
+    for b in data:
+        h ^= b
+        h = (h * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+header = struct.pack(
+    "<8sIHHBBBxHHQQ24x",
+    MAGIC,
+    VERSION,
+    args.input_size,
+    args.hidden_size,
+    args.input_buckets,
+    args.mirrored,
+    args.output_buckets,
+    args.l2_size,
+    args.l3_size,
+    len(payload),
+    fnv1a(payload),
+)
+
+assert len(header) == 64
+
+with open(args.output, "wb") as f:
+    f.write(header)
+    f.write(payload)
+
+print("payload:  ", len(payload), "bytes")
+print("checksum: ", hex(fnv1a(payload)))
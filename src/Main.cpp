@@ -1,11 +1,15 @@
 #include "core/Attacks.h"
+#include "core/Cuckoo.h"
+#include "core/KeyHistory.h"
 #include "core/Position.h"
 #include "core/Util.h"
 #include "core/Zobrist.h"
 #include "nnue/Network.h"
-#include "search/History.h"
-#include "search/LogTable.h"
+#include "nnue/Simd.h"
+#include "search/EvalCache.h"
+#include "search/Reduction.h"
 #include "search/TTable.h"
+#include "search/ThreadPool.h"
 #include "uci/Commands.h"
 
 #include <atomic>
@@ -19,19 +23,23 @@ char const *VERSION_NUMBER = "DEBUG";
 
 using namespace pali;
 
-int main(int argc, char *argv[]) {
+int main() {
+  std::cout << "Pali " << VERSION_NUMBER << " by Nek" << std::endl;
+
   initAttackTables();
   initZobrist();
-  initLogTable();
-  initNNUE(argv[0]);
-
-  std::cout << "Pali " << VERSION_NUMBER << " by Nek" << std::endl;
+  initCuckoo();
+  initReductions();
+  initNNUE();
+  simd::initSimd();
 
   Options Opts;
   Position RootPos(STARTPOS);
+  KeyHistory History;
   TTable TTable;
-  HTable HTable;
+  EvalCache EvalCache;
   std::atomic<bool> Stopped = true;
+  ThreadPool ThreadPool(Stopped, TTable, EvalCache);
   std::string Input;
 
   while (true) {
@@ -51,21 +59,36 @@ int main(int argc, char *argv[]) {
       command::isready();
 
     else if (Cmd == "ucinewgame")
-      command::ucinewgame(Params, RootPos, Opts, TTable, HTable);
+      command::ucinewgame(Params, RootPos, History, Opts, TTable, ThreadPool);
 
     else if (Cmd == "position")
-      command::position(Params, RootPos);
+      command::position(Params, RootPos, History);
 
     else if (Cmd == "setoption")
-      command::setoption(Params, Opts, TTable);
+      command::setoption(Params, Opts, TTable, EvalCache, ThreadPool);
 
     else if (Cmd == "go")
-      command::go(Params, RootPos, Opts, Stopped, TTable, HTable);
+      command::go(Params, RootPos, History, Opts, Stopped, ThreadPool);
+
+    else if (Cmd == "evalbatch")
+      command::evalbatch(Params, ThreadPool);
+
+    else if (Cmd == "stats")
+      command::stats(EvalCache, TTable);
+
+    else if (Cmd == "evalbench")
+      command::evalbench(Params, RootPos, ThreadPool);
+
+    else if (Cmd == "savehash")
+      command::savehash(Params, TTable, ThreadPool);
+
+    else if (Cmd == "loadhash")
+      command::loadhash(Params, TTable, ThreadPool);
 
     else if (Cmd == "stop")
-      command::stop(Stopped);
+      command::stop(Stopped, ThreadPool);
 
     else if (Cmd == "quit" || Cmd == "exit")
-      command::exit();
+      command::exit(ThreadPool);
   }
 }
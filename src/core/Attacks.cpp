@@ -17,6 +17,7 @@ std::array<std::array<Bitboard, 512>, 64> BISHOP_ATTACKS;
 std::array<std::array<Bitboard, 4096>, 64> ROOK_ATTACKS;
 
 Bitboard BETWEEN_SQ[64][64];
+Bitboard LINE_SQ[64][64];
 
 Bitboard pali::getPawnAttack(Square Sq, Color Col) {
   return PAWN_ATTACKS[Sq][Col];
@@ -38,6 +39,8 @@ Bitboard pali::getBetweenSq(Square Sq1, Square Sq2) {
   return BETWEEN_SQ[Sq1][Sq2];
 }
 
+Bitboard pali::getLineSq(Square Sq1, Square Sq2) { return LINE_SQ[Sq1][Sq2]; }
+
 void initPawnAttack() {
   for (Square Sq = 0; Sq < 64; Sq += 1) {
     uint64_t CurrentSq = Sq.toBB();
@@ -155,17 +158,27 @@ void initBetweenSq() {
       // Generate attack between the Squares if the Squares are on
       // the same rank, file or diagonal, bitand is there to ensure
       // that only the aligned rays are stored
-      if (Diag1 == Diag2 || AntiDiag1 == AntiDiag2)
+      // The lines are the same with an empty board, where the other
+      // rays of the Squares are parallel and never cross
+      if (Diag1 == Diag2 || AntiDiag1 == AntiDiag2) {
         BETWEEN_SQ[Sq1][Sq2] = getBishopAttack(Sq1, Sqs) &
                                getBishopAttack(Sq2, Sqs);
+        LINE_SQ[Sq1][Sq2] = (getBishopAttack(Sq1, 0) &
+                             getBishopAttack(Sq2, 0)) | Sqs;
+      }
 
-      if (File1 == File2 || Rank1 == Rank2)
+      if (File1 == File2 || Rank1 == Rank2) {
         BETWEEN_SQ[Sq1][Sq2] = getRookAttack(Sq1, Sqs) &
                                getRookAttack(Sq2, Sqs);
+        LINE_SQ[Sq1][Sq2] = (getRookAttack(Sq1, 0) &
+                             getRookAttack(Sq2, 0)) | Sqs;
+      }
 
       /// There's nothing between the same Square
-      if (Sq1 == Sq2)
+      if (Sq1 == Sq2) {
         BETWEEN_SQ[Sq1][Sq2] = 0;
+        LINE_SQ[Sq1][Sq2] = 0;
+      }
       // clang-format on
     }
   }
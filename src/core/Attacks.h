@@ -22,7 +22,7 @@ namespace pali {
 [[nodiscard]] Bitboard getRookAttack(Square Sq, Bitboard Occ);
 
 /// Return a bitboard containing all squares that a queen can attack
-[[nodiscard]] constexpr Bitboard getQueenAttack(Square Sq, Bitboard Occ) {
+[[nodiscard]] inline Bitboard getQueenAttack(Square Sq, Bitboard Occ) {
   return getBishopAttack(Sq, Occ) | getRookAttack(Sq, Occ);
 }
 
@@ -30,6 +30,10 @@ namespace pali {
 /// Return empty bitboard if they aren't aligned
 [[nodiscard]] Bitboard getBetweenSq(Square Sq1, Square Sq2);
 
+/// Return a bitboard containing the whole line through the given squares
+/// from edge to edge, empty bitboard if they aren't aligned
+[[nodiscard]] Bitboard getLineSq(Square Sq1, Square Sq2);
+
 /// Initialize attack lookup tables for all pieces
 void initAttackTables();
 
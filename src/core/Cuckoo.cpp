@@ -0,0 +1,90 @@
+#include "Cuckoo.h"
+
+#include "core/Attacks.h"
+#include "core/Bitboard.h"
+#include "core/Color.h"
+#include "core/Piece.h"
+#include "core/Square.h"
+#include "core/Zobrist.h"
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+using namespace pali;
+
+// There are 3668 reversible moves, every one fits into one of its two slots
+constexpr int CUCKOO_SIZE = 8192;
+
+uint64_t CUCKOO_KEYS[CUCKOO_SIZE];
+std::pair<Square, Square> CUCKOO_MOVES[CUCKOO_SIZE];
+
+int cuckooSlot1(uint64_t Key) { return Key & (CUCKOO_SIZE - 1); }
+
+int cuckooSlot2(uint64_t Key) { return (Key >> 16) & (CUCKOO_SIZE - 1); }
+
+/// Squares the piece attacks from the given square on an empty board
+Bitboard emptyBoardAttack(Piece Pc, Square Sq) {
+  switch (Pc) {
+  case Piece::Knight:
+    return getKnightAttack(Sq);
+  case Piece::Bishop:
+    return getBishopAttack(Sq, 0);
+  case Piece::Rook:
+    return getRookAttack(Sq, 0);
+  case Piece::Queen:
+    return getQueenAttack(Sq, 0);
+  case Piece::King:
+    return getKingAttack(Sq);
+  }
+
+  return 0;
+}
+
+void pali::initCuckoo() {
+  for (uint64_t &Key : CUCKOO_KEYS)
+    Key = 0;
+
+  for (int Col = Color::White; Col <= Color::Black; ++Col) {
+    for (int Pc = Piece::Knight; Pc <= Piece::King; ++Pc) {
+      for (int Sq1 = 0; Sq1 < 64; ++Sq1) {
+        for (int Sq2 = Sq1 + 1; Sq2 < 64; ++Sq2) {
+          if (!emptyBoardAttack(static_cast<Piece::Type>(Pc), Sq1).getBit(Sq2))
+            continue;
+
+          uint64_t Key = getPieceKey(static_cast<Piece::Type>(Pc), Sq1) ^
+                         getPieceKey(static_cast<Piece::Type>(Pc), Sq2) ^
+                         getColorKey(static_cast<Color::Type>(Col), Sq1) ^
+                         getColorKey(static_cast<Color::Type>(Col), Sq2) ^
+                         getStmKey();
+          std::pair<Square, Square> Move = {Square(Sq1), Square(Sq2)};
+
+          // Kick out whatever is in the slot and move it to its other slot
+          // until one is empty
+          int Slot = cuckooSlot1(Key);
+          while (true) {
+            std::swap(CUCKOO_KEYS[Slot], Key);
+            std::swap(CUCKOO_MOVES[Slot], Move);
+
+            if (Key == 0)
+              break;
+
+            Slot = Slot == cuckooSlot1(Key) ? cuckooSlot2(Key)
+                                            : cuckooSlot1(Key);
+          }
+        }
+      }
+    }
+  }
+}
+
+bool pali::findReversibleMove(uint64_t MoveKey, Square &Sq1, Square &Sq2) {
+  for (int Slot : {cuckooSlot1(MoveKey), cuckooSlot2(MoveKey)}) {
+    if (CUCKOO_KEYS[Slot] == MoveKey) {
+      std::tie(Sq1, Sq2) = CUCKOO_MOVES[Slot];
+      return true;
+    }
+  }
+
+  return false;
+}
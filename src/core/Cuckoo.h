@@ -0,0 +1,19 @@
+#pragma once
+
+#include "core/Square.h"
+
+#include <cstdint>
+
+namespace pali {
+
+/// Fill the cuckoo tables of reversible moves,
+/// attack tables and Zobrist keys have to be initialized first
+void initCuckoo();
+
+/// Find the reversible move that changes the hash by the given key,
+/// a non-pawn piece moving between the two squares and the side to move
+/// changing. Return false if there's none
+[[nodiscard]] bool findReversibleMove(uint64_t MoveKey, Square &Sq1,
+                                      Square &Sq2);
+
+} // namespace pali
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace pali {
+
+/// Hashes of the positions before the current one, for repetition detection.
+/// Preallocated so making moves never allocates: the game only needs the
+/// plies since its last capture or pawn move, the search adds one per ply
+class KeyHistory {
+public:
+  /// Longest game part kept, a game is drawn by the fifty move rule
+  /// long before that many plies without a capture or pawn move
+  static constexpr int MAX_GAME_PLY = 1024;
+
+  /// Longest line of a search, quiescence included
+  static constexpr int MAX_SEARCH_PLY = 256;
+
+private:
+  std::array<uint64_t, MAX_GAME_PLY + MAX_SEARCH_PLY> Keys;
+  int Size = 0;
+
+public:
+  void clear() { Size = 0; }
+
+  void push(uint64_t Hash) { Keys[Size++] = Hash; }
+
+  void pop() { --Size; }
+
+  /// Drop all but the hashes of the last given number of plies
+  void keepLast(int Plies) {
+    Plies = std::min(Plies, Size);
+    std::copy(Keys.begin() + Size - Plies, Keys.begin() + Size, Keys.begin());
+    Size = Plies;
+  }
+
+  [[nodiscard]] int size() const { return Size; }
+
+  /// Hash of the position the given number of plies ago, starting at 1
+  [[nodiscard]] uint64_t ago(int Plies) const { return Keys[Size - Plies]; }
+};
+
+} // namespace pali
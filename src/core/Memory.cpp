@@ -0,0 +1,300 @@
+#include "core/Memory.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/mman.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace pali;
+
+/// Mount points of every hugetlbfs
+std::vector<std::string> hugetlbfsMounts() {
+  std::vector<std::string> Mounts;
+  std::ifstream File("/proc/mounts");
+  std::string Device, MountPoint, Type, Rest;
+
+  while (File >> Device >> MountPoint >> Type && std::getline(File, Rest))
+    if (Type == "hugetlbfs")
+      Mounts.push_back(MountPoint);
+
+  return Mounts;
+}
+
+/// Remove the private copies of the segment at Path that processes
+/// killed while building them left behind
+void removeStaleCopies(const std::string &Path) {
+  const std::size_t Slash = Path.rfind('/');
+  const std::string Dir = Path.substr(0, Slash);
+  const std::string Prefix = Path.substr(Slash + 1) + ".";
+
+  DIR *Handle = opendir(Dir.c_str());
+  if (Handle == nullptr)
+    return;
+
+  while (const dirent *Entry = readdir(Handle)) {
+    const std::string Name = Entry->d_name;
+    if (Name.size() <= Prefix.size() || Name.compare(0, Prefix.size(), Prefix))
+      continue;
+
+    char *End;
+    const long Pid = std::strtol(Name.c_str() + Prefix.size(), &End, 10);
+    if (*End != '\0' || Pid <= 0)
+      continue;
+
+    // Our own pid can only be left from a dead process that had it before
+    const bool Dead =
+        Pid == getpid() || (kill(Pid, 0) != 0 && errno == ESRCH);
+
+    struct stat Stat;
+    const std::string EntryPath = Dir + "/" + Name;
+    if (Dead && stat(EntryPath.c_str(), &Stat) == 0 &&
+        Stat.st_uid == geteuid())
+      unlink(EntryPath.c_str());
+  }
+
+  closedir(Handle);
+}
+
+/// Map the segment at Path, creating it first if it doesn't exist yet
+bool mapSegment(const std::string &Path, std::size_t Size,
+                const std::function<void(uint8_t *)> &Init,
+                SharedMapping &Mapping) {
+  // Whole huge pages, both for hugetlbfs and for transparent huge pages
+  const std::size_t MapSize =
+      (Size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  int Fd = open(Path.c_str(), O_RDONLY);
+
+  if (Fd < 0) {
+    removeStaleCopies(Path);
+
+    // Build the segment under a private name and publish it atomically
+    // so other processes never see it half written
+    const std::string TmpPath = Path + "." + std::to_string(getpid());
+
+    int TmpFd = open(TmpPath.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (TmpFd < 0)
+      return false;
+
+    void *Data = MAP_FAILED;
+    if (ftruncate(TmpFd, MapSize) == 0)
+      Data = mmap(nullptr, MapSize, PROT_READ | PROT_WRITE, MAP_SHARED, TmpFd,
+                  0);
+    close(TmpFd);
+
+    if (Data == MAP_FAILED) {
+      unlink(TmpPath.c_str());
+      return false;
+    }
+
+    madvise(Data, MapSize, MADV_HUGEPAGE);
+    Init(static_cast<uint8_t *>(Data));
+    munmap(Data, MapSize);
+
+    // Losing the race to another process is fine, its segment is identical
+    bool Published =
+        link(TmpPath.c_str(), Path.c_str()) == 0 || errno == EEXIST;
+    unlink(TmpPath.c_str());
+
+    if (!Published)
+      return false;
+
+    Fd = open(Path.c_str(), O_RDONLY);
+    if (Fd < 0)
+      return false;
+  }
+
+  // Only trust segments made by our own user
+  struct stat Stat;
+  if (fstat(Fd, &Stat) != 0 || Stat.st_uid != geteuid() ||
+      static_cast<std::size_t>(Stat.st_size) < Size) {
+    close(Fd);
+    return false;
+  }
+
+  void *Data = mmap(nullptr, MapSize, PROT_READ, MAP_SHARED, Fd, 0);
+  close(Fd);
+
+  if (Data == MAP_FAILED)
+    return false;
+
+  Mapping = {static_cast<const uint8_t *>(Data), MapSize, Path};
+
+  return true;
+}
+
+bool pali::mapShared(const std::string &Name, std::size_t Size,
+                     const std::function<void(uint8_t *)> &Init,
+                     SharedMapping &Mapping) {
+  for (const std::string &Mount : hugetlbfsMounts())
+    if (mapSegment(Mount + "/" + Name, Size, Init, Mapping))
+      return true;
+
+  return mapSegment("/dev/shm/" + Name, Size, Init, Mapping);
+}
+
+void pali::unmapShared(SharedMapping &Mapping) {
+  if (Mapping.Data)
+    munmap(const_cast<uint8_t *>(Mapping.Data), Mapping.Size);
+
+  Mapping = SharedMapping();
+}
+
+void *pali::openShared(const std::string &Name, std::size_t &Size,
+                       bool &Created) {
+  int Fd = shm_open(Name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  Created = Fd >= 0;
+
+  if (Created) {
+    if (ftruncate(Fd, Size) != 0) {
+      close(Fd);
+      shm_unlink(Name.c_str());
+      return nullptr;
+    }
+  } else {
+    if (errno != EEXIST)
+      return nullptr;
+
+    Fd = shm_open(Name.c_str(), O_RDWR, 0600);
+    if (Fd < 0)
+      return nullptr;
+
+    // The creator might not have sized it yet
+    struct stat Stat {};
+    for (int Tries = 0;
+         fstat(Fd, &Stat) == 0 && Stat.st_size == 0 && Tries < 1000; ++Tries)
+      usleep(1000);
+
+    if (Stat.st_size == 0) {
+      close(Fd);
+      return nullptr;
+    }
+
+    Size = Stat.st_size;
+  }
+
+  void *Data =
+      mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+  close(Fd);
+
+  if (Data == MAP_FAILED)
+    return nullptr;
+
+  madvise(Data, Size, MADV_HUGEPAGE);
+
+  return Data;
+}
+
+void pali::closeShared(void *Ptr, std::size_t Size) {
+  if (Ptr)
+    munmap(Ptr, Size);
+}
+
+/// Round up to whole huge pages
+std::size_t hugeSize(std::size_t Size) {
+  return (Size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+void *pali::allocHuge(std::size_t Size) {
+  const std::size_t MapSize = hugeSize(Size);
+
+  // Huge page pools, mappings from them are always aligned
+  if (Size % GIGANTIC_PAGE_SIZE == 0) {
+    void *Data = mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_1GB,
+                      -1, 0);
+    if (Data != MAP_FAILED)
+      return Data;
+  }
+
+  if (Size % HUGE_PAGE_SIZE == 0) {
+    void *Data = mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB,
+                      -1, 0);
+    if (Data != MAP_FAILED)
+      return Data;
+  }
+
+  // Transparent huge pages need the mapping aligned to a huge page,
+  // map one more and trim the ends
+  void *Mapped = mmap(nullptr, MapSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (Mapped == MAP_FAILED)
+    return nullptr;
+
+  const uintptr_t Start = reinterpret_cast<uintptr_t>(Mapped);
+  const uintptr_t Aligned =
+      (Start + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  if (Aligned != Start)
+    munmap(Mapped, Aligned - Start);
+
+  const uintptr_t End = Start + MapSize + HUGE_PAGE_SIZE;
+  if (End != Aligned + MapSize)
+    munmap(reinterpret_cast<void *>(Aligned + MapSize),
+           End - (Aligned + MapSize));
+
+  void *Data = reinterpret_cast<void *>(Aligned);
+  madvise(Data, MapSize, MADV_HUGEPAGE);
+
+  return Data;
+}
+
+void pali::freeHuge(void *Ptr, std::size_t Size) {
+  if (Ptr)
+    munmap(Ptr, hugeSize(Size));
+}
+
+bool pali::isHugePageBacked(const void *Addr) {
+  const uintptr_t Target = reinterpret_cast<uintptr_t>(Addr);
+
+  std::ifstream File("/proc/self/smaps");
+  std::string Line;
+  bool InRegion = false;
+
+  while (std::getline(File, Line)) {
+    // Each region starts with its address range followed by its fields
+    unsigned long Start, End;
+    if (std::sscanf(Line.c_str(), "%lx-%lx", &Start, &End) == 2) {
+      if (InRegion)
+        break;
+
+      InRegion = Start <= Target && Target < End;
+      continue;
+    }
+
+    if (!InRegion)
+      continue;
+
+    std::istringstream Fields(Line);
+    std::string Name;
+    uint64_t Value = 0;
+    Fields >> Name >> Value;
+
+    // hugetlbfs
+    if (Name == "KernelPageSize:" && Value >= 2048)
+      return true;
+
+    // Transparent huge pages
+    if ((Name == "AnonHugePages:" || Name == "ShmemPmdMapped:" ||
+         Name == "FilePmdMapped:") &&
+        Value > 0)
+      return true;
+  }
+
+  return false;
+}
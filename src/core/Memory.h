@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace pali {
+
+/// Size of a huge page on x86-64 Linux
+constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/// Size of a gigantic page on x86-64 Linux
+constexpr std::size_t GIGANTIC_PAGE_SIZE = 1024 * 1024 * 1024;
+
+/// Read-only mapping of a named segment shared between processes
+struct SharedMapping {
+  const uint8_t *Data = nullptr;
+  std::size_t Size = 0;
+  std::string Path;
+};
+
+/// Map the named segment read-only, creating it first with Init if no other
+/// process has done so yet.
+/// Segments go to a mounted hugetlbfs when it has pages to spare,
+/// otherwise to /dev/shm with transparent huge pages requested.
+/// Return false if no shared memory is available
+bool mapShared(const std::string &Name, std::size_t Size,
+               const std::function<void(uint8_t *)> &Init,
+               SharedMapping &Mapping);
+
+void unmapShared(SharedMapping &Mapping);
+
+/// Read-write mapping of the POSIX shared memory segment of the given name,
+/// created zeroed with Size bytes if it doesn't exist yet.
+/// Size is set to the size of the segment, Created to whether it was made
+/// by this call. Returns nullptr on failure
+[[nodiscard]] void *openShared(const std::string &Name, std::size_t &Size,
+                               bool &Created);
+
+/// Unmap a segment from openShared(), it stays for other processes
+void closeShared(void *Ptr, std::size_t Size);
+
+/// Allocate zeroed memory aligned to a huge page, or return nullptr.
+/// Sizes made of whole gigantic or huge pages are taken from the kernel's
+/// huge page pools when they have pages to spare,
+/// everything else gets transparent huge pages.
+/// Pages are only placed when first touched, so whoever touches them first
+/// decides their NUMA node
+[[nodiscard]] void *allocHuge(std::size_t Size);
+
+/// Free memory from allocHuge() of the same size
+void freeHuge(void *Ptr, std::size_t Size);
+
+/// Whether the page containing Addr is backed by a huge page
+[[nodiscard]] bool isHugePageBacked(const void *Addr);
+
+} // namespace pali
@@ -0,0 +1,90 @@
+#include "core/Numa.h"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace pali;
+
+/// Parse a CPU list like 0-15,32-47
+std::vector<int> parseCpuList(const std::string &List) {
+  std::vector<int> Cpus;
+  std::istringstream Ranges(List);
+  std::string Range;
+
+  while (std::getline(Ranges, Range, ',')) {
+    if (Range.empty())
+      continue;
+
+    const std::size_t Dash = Range.find('-');
+    const int First = std::stoi(Range.substr(0, Dash));
+    const int Last =
+        Dash == std::string::npos ? First : std::stoi(Range.substr(Dash + 1));
+
+    for (int Cpu = First; Cpu <= Last; ++Cpu)
+      Cpus.push_back(Cpu);
+  }
+
+  return Cpus;
+}
+
+std::vector<NumaNode> pali::numaNodes() {
+  std::vector<NumaNode> Nodes;
+  std::error_code Error;
+
+  for (const auto &Entry : std::filesystem::directory_iterator(
+           "/sys/devices/system/node", Error)) {
+    const std::string Name = Entry.path().filename();
+    if (Name.rfind("node", 0) != 0 ||
+        Name.find_first_not_of("0123456789", 4) != std::string::npos)
+      continue;
+
+    std::ifstream File(Entry.path() / "cpulist");
+    std::string List;
+    std::getline(File, List);
+
+    // Memory only nodes have no CPUs to run threads on
+    std::vector<int> Cpus = parseCpuList(List);
+    if (!Cpus.empty())
+      Nodes.push_back({std::stoi(Name.substr(4)), Cpus});
+  }
+
+  std::sort(Nodes.begin(), Nodes.end(),
+            [](const NumaNode &A, const NumaNode &B) { return A.Id < B.Id; });
+
+  return Nodes;
+}
+
+bool pali::pinThread(const NumaNode &Node) {
+  cpu_set_t Set;
+  CPU_ZERO(&Set);
+
+  for (int Cpu : Node.Cpus)
+    if (Cpu < CPU_SETSIZE)
+      CPU_SET(Cpu, &Set);
+
+  return sched_setaffinity(0, sizeof(Set), &Set) == 0;
+}
+
+bool pali::interleaveMemory(void *Ptr, std::size_t Size,
+                            const std::vector<NumaNode> &Nodes) {
+  constexpr int MAX_NODES = 1024;
+  std::array<unsigned long, MAX_NODES / 64> Mask = {};
+
+  for (const NumaNode &Node : Nodes)
+    if (Node.Id < MAX_NODES)
+      Mask[Node.Id / 64] |= 1UL << Node.Id % 64;
+
+  return syscall(SYS_mbind, Ptr, Size, MPOL_INTERLEAVE, Mask.data(),
+                 MAX_NODES, MPOL_MF_MOVE) == 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace pali {
+
+/// A NUMA node and the CPUs it's made of
+struct NumaNode {
+  int Id;
+  std::vector<int> Cpus;
+};
+
+/// Nodes listed under /sys/devices/system/node,
+/// empty when the kernel doesn't report any
+[[nodiscard]] std::vector<NumaNode> numaNodes();
+
+/// Restrict the calling thread to the CPUs of the node
+bool pinThread(const NumaNode &Node);
+
+/// Spread the pages of the memory round robin over the nodes,
+/// moving pages that are already placed. Ptr has to be page aligned
+bool interleaveMemory(void *Ptr, std::size_t Size,
+                      const std::vector<NumaNode> &Nodes);
+
+} // namespace pali
@@ -3,12 +3,14 @@
 #include "core/Attacks.h"
 #include "core/Bitboard.h"
 #include "core/Color.h"
+#include "core/Cuckoo.h"
+#include "core/KeyHistory.h"
 #include "core/Move.h"
 #include "core/Piece.h"
 #include "core/Square.h"
 #include "core/Util.h"
 #include "core/Zobrist.h"
-#include "nnue/Network.h"
+#include "nnue/AccumulatorStack.h"
 
 #include <algorithm>
 #include <cctype>
@@ -19,9 +21,6 @@
 using namespace pali;
 
 Position::Position(const std::string &Fen) {
-  Acc[0] = NNUE.InputBias;
-  Acc[1] = NNUE.InputBias;
-
   auto Tokens = tokenize(Fen);
 
   // clang-format off
@@ -85,6 +84,8 @@ Position::Position(const std::string &Fen) {
 
   // Parse halfmove clock
   Hmc = std::stoi(Tokens[4]);
+
+  updateChecks();
 }
 
 // clang-format off
@@ -110,6 +111,75 @@ Bitboard Position::attacksAt(Square sq, Bitboard occ) const {
 }
 // clang-format on
 
+void Position::updateChecks() {
+  const Square King = kingSq();
+  const Bitboard Them = getBB(Stm.inverse());
+
+  Checkers = attacksAt(King) & Them;
+  Pinned = 0;
+
+  // Enemy sliders that would attack the king without our pieces in the way
+  // clang-format off
+  Bitboard Pinners =
+      (getBishopAttack(King, Them) &
+          (getBB(Piece::Bishop) | getBB(Piece::Queen)) & Them) |
+      (getRookAttack(King, Them) &
+          (getBB(Piece::Rook) | getBB(Piece::Queen)) & Them);
+  // clang-format on
+
+  while (Pinners) {
+    const Bitboard Between = getBetweenSq(King, Pinners.takeLsb()) & allBB();
+
+    // A single piece of ours in the way is pinned
+    if (Between.popcnt() == 1 && Between & getBB(Stm))
+      Pinned |= Between;
+  }
+}
+
+Bitboard Position::kingTargets() const {
+  const Square King = kingSq();
+
+  // The king can't hide behind itself from a slider
+  const Bitboard Occ = allBB() ^ King.toBB();
+
+  Bitboard Targets = getKingAttack(King) & ~getBB(Stm);
+  Bitboard Safe = 0;
+
+  while (Targets) {
+    const Square To = Targets.takeLsb();
+    if (!(attacksAt(To, Occ) & getBB(Stm.inverse())))
+      Safe.set(To);
+  }
+
+  return Safe;
+}
+
+bool Position::isLegalEP(Square From) const {
+  const Square Captured = EpSq - Square(Stm ? 8 : -8);
+
+  // Two pawns leave the line at once, look at the board after the capture
+  const Bitboard Occ =
+      (allBB() ^ From.toBB() ^ Captured.toBB()) | EpSq.toBB();
+  const Bitboard Them = getBB(Stm.inverse()) ^ Captured.toBB();
+
+  return !(attacksAt(kingSq(), Occ) & Them);
+}
+
+bool Position::isLegal(Move Mv) const {
+  if (Mv.Pc == Piece::King) {
+    // The generator already made sure nothing attacks the king's path
+    if (Mv.isCastle())
+      return !(attacksAt(Mv.To) & getBB(Stm.inverse()));
+
+    return kingTargets().getBit(Mv.To);
+  }
+
+  if (Mv.isEP())
+    return isLegalEP(Mv.From);
+
+  return legalTargets(Mv.From).getBit(Mv.To);
+}
+
 void Position::genNoisy(MoveList &Ml) const {
   const Bitboard Occ = allBB();
 
@@ -122,17 +192,21 @@ void Position::genNoisy(MoveList &Ml) const {
 
   { // Generate king moves
     // Only one king can exist for each side.
-    Square From = getBB(Piece::King, Stm).lsb();
-    Bitboard Attacks = getKingAttack(From);
+    Square From = kingSq();
+    Bitboard Attacks = kingTargets();
 
     addCaptures(From, Attacks, Piece::King);
   }
 
+  // Only the king can move out of a double check
+  if (Checkers.popcnt() > 1)
+    return;
+
   { // Generate knight moves
     Bitboard FromsBB = getBB(Piece::Knight, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getKnightAttack(From);
+      Bitboard Attacks = getKnightAttack(From) & legalTargets(From);
 
       addCaptures(From, Attacks, Piece::Knight);
     }
@@ -142,7 +216,7 @@ void Position::genNoisy(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Bishop, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getBishopAttack(From, Occ);
+      Bitboard Attacks = getBishopAttack(From, Occ) & legalTargets(From);
 
       addCaptures(From, Attacks, Piece::Bishop);
     }
@@ -152,7 +226,7 @@ void Position::genNoisy(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Rook, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getRookAttack(From, Occ);
+      Bitboard Attacks = getRookAttack(From, Occ) & legalTargets(From);
 
       addCaptures(From, Attacks, Piece::Rook);
     }
@@ -162,7 +236,7 @@ void Position::genNoisy(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Queen, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getQueenAttack(From, Occ);
+      Bitboard Attacks = getQueenAttack(From, Occ) & legalTargets(From);
 
       addCaptures(From, Attacks, Piece::Queen);
     }
@@ -178,12 +252,15 @@ void Position::genNoisy(MoveList &Ml) const {
 
       // Add en passant capture if possible
       if (EpSq.exists() && Attacks.getBit(EpSq)) {
-        Ml.push_back({From, EpSq, MFlag::EnPassant, Piece::Pawn});
+        if (isLegalEP(From))
+          Ml.push_back({From, EpSq, MFlag::EnPassant, Piece::Pawn});
         Attacks.pop(EpSq); // Avoid adding duplicate move
       }
 
+      Attacks &= legalTargets(From);
+
       // Check if it's a promotion
-      else if (PromoRank.getBit(From)) {
+      if (PromoRank.getBit(From)) {
         Attacks &= getBB(Stm.inverse());
         while (Attacks) {
           Square To = Attacks.takeLsb();
@@ -215,17 +292,21 @@ void Position::genQuiet(MoveList &Ml) const {
 
   { // Generate king moves
     // Only one king can exist for each side.
-    Square From = getBB(Piece::King, Stm).lsb();
-    Bitboard Attacks = getKingAttack(From);
+    Square From = kingSq();
+    Bitboard Attacks = kingTargets();
 
     addNormal(From, Attacks, Piece::King);
   }
 
+  // Only the king can move out of a double check
+  if (Checkers.popcnt() > 1)
+    return;
+
   { // Generate knight moves
     Bitboard FromsBB = getBB(Piece::Knight, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getKnightAttack(From);
+      Bitboard Attacks = getKnightAttack(From) & legalTargets(From);
 
       addNormal(From, Attacks, Piece::Knight);
     }
@@ -235,7 +316,7 @@ void Position::genQuiet(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Bishop, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getBishopAttack(From, Occ);
+      Bitboard Attacks = getBishopAttack(From, Occ) & legalTargets(From);
 
       addNormal(From, Attacks, Piece::Bishop);
     }
@@ -245,7 +326,7 @@ void Position::genQuiet(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Rook, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getRookAttack(From, Occ);
+      Bitboard Attacks = getRookAttack(From, Occ) & legalTargets(From);
 
       addNormal(From, Attacks, Piece::Rook);
     }
@@ -255,7 +336,7 @@ void Position::genQuiet(MoveList &Ml) const {
     Bitboard FromsBB = getBB(Piece::Queen, Stm);
     while (FromsBB) {
       Square From = FromsBB.takeLsb();
-      Bitboard Attacks = getQueenAttack(From, Occ);
+      Bitboard Attacks = getQueenAttack(From, Occ) & legalTargets(From);
 
       addNormal(From, Attacks, Piece::Queen);
     }
@@ -285,6 +366,9 @@ void Position::genQuiet(MoveList &Ml) const {
       Square To = PushesBB.takeLsb();
       Square From = Stm.isWhite() ? To + Square(8) : To - Square(8);
 
+      if (!legalTargets(From).getBit(To))
+        continue;
+
       // The move might be promotion
       if (PromoRank.getBit(From)) {
         // Add each promotion type
@@ -303,6 +387,9 @@ void Position::genQuiet(MoveList &Ml) const {
       Square To = DPsBB.takeLsb();
       Square From = Stm.isWhite() ? To + Square(16) : To - Square(16);
 
+      if (!legalTargets(From).getBit(To))
+        continue;
+
       Ml.push_back({From, To, MFlag::DoublePush, Piece::Pawn});
     }
   }
@@ -315,10 +402,10 @@ void Position::genQuiet(MoveList &Ml) const {
       Bitboard Path = getBetweenSq(KingFrom, RookFrom);
       if (Rights & Castle && // Has rights
           !(Occ & Path) &&   // Nothing in the way
-          !isInCheck() &&    // Not in check
+          !Checkers &&       // Not in check
           [this, KingFrom, KingTo]() {
-            // Nothing attacking the king's path
-            Bitboard KingPath = getBetweenSq(KingFrom, KingTo);
+            // Nothing attacking the king's path or destination
+            Bitboard KingPath = getBetweenSq(KingFrom, KingTo) | KingTo.toBB();
             while (KingPath)
               if (attacksAt(KingPath.takeLsb()) & getBB(Stm.inverse()))
                 return false;
@@ -338,22 +425,48 @@ void Position::genQuiet(MoveList &Ml) const {
   }
 }
 
-bool Position::makeMove(Move Mv) {
+/// Rook squares of a castling move by the king's destination
+std::pair<Square, Square> castlingRook(Square KingTo) {
+  switch (KingTo) {
+  case Square::G1:
+    return {Square::H1, Square::F1};
+  case Square::C1:
+    return {Square::A1, Square::D1};
+  case Square::G8:
+    return {Square::H8, Square::F8};
+  case Square::C8:
+    return {Square::A8, Square::D8};
+  }
+
+  std::unreachable();
+}
+
+void Position::makeMove(Move Mv, StateInfo &State) {
   [[maybe_unused]] const auto [From, To, Flag, Pc, Score] = Mv;
 
   // We will clear pawn captured by en passant
   // and update EpSQ in case of double push on this squar
   Square EpCaptureSq = To - Square(Stm ? 8 : -8);
 
-  OccuredPos.push_back(Hash);
+  saveState(State);
+  DirtyPieces &Dirty = State.Dirty;
 
   // Pawn moved, half move clock resets
   if (Pc == Piece::Pawn)
     Hmc = 0;
 
+  Piece AddedPiece = Mv.isPromo() ? Mv.promoType() : Pc;
+
+  // Record changed features for the lazy accumulator updates
+  Dirty.clear();
+  Dirty.add(AddedPiece, Stm, To);
+  Dirty.remove(Pc, Stm, From);
+
   // En passant capture
-  if (Mv.isEP())
+  if (Mv.isEP()) {
     clearPiece(Piece::Pawn, Stm.inverse(), EpCaptureSq);
+    Dirty.remove(Piece::Pawn, Stm.inverse(), EpCaptureSq);
+  }
 
   // Clear out captured piece
   else if (Mv.isCapture()) {
@@ -367,29 +480,21 @@ bool Position::makeMove(Move Mv) {
     }();
 
     clearPiece(TargetPc, Stm.inverse(), To);
+    Dirty.remove(TargetPc, Stm.inverse(), To);
+    State.Captured = TargetPc;
     Hmc = 0;
   }
 
   // Move the rook when castling
   else if (Mv.isCastle()) {
-    switch (To) {
-    case Square::G1:
-      movePiece(Piece::Rook, Stm, Square::H1, Square::F1);
-      break;
-    case Square::C1:
-      movePiece(Piece::Rook, Stm, Square::A1, Square::D1);
-      break;
-    case Square::G8:
-      movePiece(Piece::Rook, Stm, Square::H8, Square::F8);
-      break;
-    case Square::C8:
-      movePiece(Piece::Rook, Stm, Square::A8, Square::D8);
-      break;
-    }
+    const auto [RookFrom, RookTo] = castlingRook(To);
+
+    movePiece(Piece::Rook, Stm, RookFrom, RookTo);
+    Dirty.add(Piece::Rook, Stm, RookTo);
+    Dirty.remove(Piece::Rook, Stm, RookFrom);
   }
 
   // Move the piece to a the destination and remove it from the old square
-  Piece AddedPiece = Mv.isPromo() ? Mv.promoType() : Pc;
   clearPiece(Pc, Stm, From);
   addPiece(AddedPiece, Stm, To);
 
@@ -421,33 +526,64 @@ bool Position::makeMove(Move Mv) {
     updateHash(getEPKey(EpSq));
   }
 
-  return !(attacksAt(getBB(Piece::King, Stm.inverse()).lsb()) & getBB(Stm));
+  updateChecks();
 }
 
-int Position::evaluate() const {
-  const auto &Us = Acc[Stm].Data;
-  const auto &Them = Acc[Stm.inverse()].Data;
+void Position::unmakeMove(Move Mv, const StateInfo &State) {
+  [[maybe_unused]] const auto [From, To, Flag, Pc, Score] = Mv;
 
-  const auto screlu = [](int16_t x) {
-    constexpr int16_t CR_MIN = 0;
-    constexpr int16_t CR_MAX = 255;
+  // Back to the side that made the move
+  Stm = Stm.inverse();
 
-    x = std::clamp(x, CR_MIN, CR_MAX);
-    return static_cast<int32_t>(x) * static_cast<int32_t>(x);
-  };
+  takePiece(Mv.isPromo() ? Mv.promoType() : Pc, Stm, To);
+  putPiece(Pc, Stm, From);
 
-  int32_t Output = 0; // Need to be 32 bits to avoid overflow
+  if (Mv.isEP())
+    putPiece(Piece::Pawn, Stm.inverse(), To - Square(Stm ? 8 : -8));
+
+  else if (Mv.isCapture())
+    putPiece(State.Captured, Stm.inverse(), To);
+
+  else if (Mv.isCastle()) {
+    const auto [RookFrom, RookTo] = castlingRook(To);
 
-  for (int i = 0; i < HIDDEN_SIZE; i++) {
-    Output +=
-        screlu(Us[i]) * static_cast<int32_t>(NNUE.OutputWeights[0].Data[i]);
-    Output +=
-        screlu(Them[i]) * static_cast<int32_t>(NNUE.OutputWeights[1].Data[i]);
+    takePiece(Piece::Rook, Stm, RookTo);
+    putPiece(Piece::Rook, Stm, RookFrom);
   }
 
-  Output /= QA;
+  restoreState(State);
+}
 
-  Output += NNUE.OutputBias;
+bool Position::hasUpcomingRepetition(const KeyHistory &History,
+                                     int Ply) const {
+  const int End = repetitionPlies(History);
+  if (End < 3)
+    return false;
+
+  // Moves of the opponent since the earlier position, they have to cancel out
+  // so that the difference is made of our moves only
+  uint64_t Other = Hash ^ History.ago(1) ^ getStmKey();
+
+  for (int i = 3; i <= End; i += 2) {
+    Other ^= History.ago(i - 1) ^ History.ago(i) ^ getStmKey();
+    if (Other != 0)
+      continue;
+
+    // The difference has to be a single reversible move with nothing in its way
+    Square Sq1, Sq2;
+    if (!findReversibleMove(Hash ^ History.ago(i), Sq1, Sq2) ||
+        getBetweenSq(Sq1, Sq2) & allBB())
+      continue;
+
+    if (Ply > i)
+      return true;
+
+    // The position is from the game, make sure the piece making the move
+    // is the side to move's
+    const Square Occupied = allBB().getBit(Sq1) ? Sq1 : Sq2;
+    if (getBB(Stm).getBit(Occupied))
+      return true;
+  }
 
-  return Output * SCALE / QAB;
+  return false;
 }
@@ -1,24 +1,42 @@
 #pragma once
 
+#include "core/Attacks.h"
 #include "core/Bitboard.h"
 #include "core/Color.h"
+#include "core/KeyHistory.h"
 #include "core/Move.h"
 #include "core/Piece.h"
 #include "core/Square.h"
 #include "core/Zobrist.h"
-#include "nnue/Network.h"
+#include "nnue/AccumulatorStack.h"
 
 #include <array>
 #include <cstdint>
+#include <algorithm>
 #include <cstdlib>
 #include <string>
-#include <vector>
 
 namespace pali {
 
 constexpr char const *STARTPOS =
     "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
+/// What a move changed that can't be worked out from the move itself,
+/// filled by makeMove() and used by unmakeMove() to take it back
+struct StateInfo {
+  uint64_t Hash;
+  Square EpSq;
+  uint8_t Rights;
+  uint8_t Hmc;
+  uint16_t PliesFromNull;
+  Bitboard Checkers;
+  Bitboard Pinned;
+  Piece Captured;
+
+  /// Features changed by the move, for the accumulators
+  DirtyPieces Dirty;
+};
+
 class Position {
   std::array<Bitboard, 6> Pieces;
   std::array<Bitboard, 2> Colors;
@@ -31,9 +49,14 @@ class Position {
 
   uint8_t Hmc;
 
-  std::array<Accumulator, 2> Acc;
+  /// Plies since the last null move, repetitions can't go past it
+  uint16_t PliesFromNull = 0;
 
-  std::vector<uint64_t> OccuredPos;
+  /// Enemy pieces giving check
+  Bitboard Checkers;
+
+  /// Pieces of the side to move that can't leave the line to their king
+  Bitboard Pinned;
 
 public:
   /// Position constructor: accepts full FEN as input and
@@ -67,9 +90,9 @@ public:
   [[nodiscard]] Bitboard attacksAt(Square Sq) const;
   [[nodiscard]] Bitboard attacksAt(Square Sq, Bitboard Occ) const;
 
-  [[nodiscard]] bool isInCheck() const {
-    return attacksAt(getBB(Piece::King, Stm).lsb()) & getBB(Stm.inverse());
-  }
+  [[nodiscard]] bool isInCheck() const { return Checkers; }
+
+  [[nodiscard]] Bitboard checkers() const { return Checkers; }
 
   /// What piece is on the given square
   [[nodiscard]] Piece pieceAt(Square Sq) const {
@@ -81,78 +104,155 @@ public:
     return Piece::None;
   }
 
-  /// Add noisy psuedolegal moves to move list
+  /// Add noisy legal moves to move list
   void genNoisy(MoveList &Ml) const;
 
-  /// Add quiet psuedolegal moves to move list
+  /// Add quiet legal moves to move list
   void genQuiet(MoveList &Ml) const;
 
-  /// Make move on the board regardless of legality
-  /// return false if the move is illegal
-  bool makeMove(Move Mv);
+  /// Whether a psuedolegal move leaves the king safe,
+  /// for moves that don't come from the generators
+  [[nodiscard]] bool isLegal(Move Mv) const;
 
-  /// Switch side to move and remove existing en passant square
-  void changeSide() {
-    // En passant square expired
-    if (EpSq.exists()) {
-      updateHash(getEPKey(EpSq));
-      EpSq = Square::None;
-    }
+  /// Make a legal move on the board,
+  /// State gets what's needed to take the move back
+  void makeMove(Move Mv, StateInfo &State);
 
-    ++Hmc;
+  /// Take back the last move made with makeMove()
+  void unmakeMove(Move Mv, const StateInfo &State);
 
-    Stm = Stm.inverse();
-    updateHash(getStmKey());
+  /// Pass the turn to the opponent
+  void makeNullMove(StateInfo &State) {
+    saveState(State);
+    changeSide();
+    PliesFromNull = 0;
+    updateChecks();
   }
 
-  [[nodiscard]] int evaluate() const;
+  /// Take back the last makeNullMove()
+  void unmakeNullMove(const StateInfo &State) {
+    Stm = Stm.inverse();
+    restoreState(State);
+  }
 
-  [[nodiscard]] bool isDraw() const {
+  /// Drawn by the fifty move rule or a repetition of a position in History,
+  /// the hashes of the positions that led to this one
+  [[nodiscard]] bool isDraw(const KeyHistory &History) const {
     if (Hmc >= 100)
       return true;
 
-    for (int i = static_cast<int>(OccuredPos.size()) - 2; i >= 0; i -= 2) {
-      if (i + Hmc < OccuredPos.size())
-        return false;
-
-      if (OccuredPos[i] == Hash)
+    // Four plies back is the first time the position could be the same
+    for (int i = 4; i <= repetitionPlies(History); i += 2)
+      if (History.ago(i) == Hash)
         return true;
-    }
 
     return false;
   }
 
+  /// The side to move has a move that repeats a position of the search,
+  /// Ply plies after its root
+  [[nodiscard]] bool hasUpcomingRepetition(const KeyHistory &History,
+                                           int Ply) const;
+
+
 private:
   void updateHash(uint64_t Key) { Hash ^= Key; }
 
-  void nnueAdd(Piece Pc, Color Col, Square Sq) {
-    const auto [WhiteIx, BlackIx] = nnueIdx(Col, Pc, Sq);
-    const auto &WhiteAdd = NNUE.InputWeights[WhiteIx].Data;
-    const auto &BlackAdd = NNUE.InputWeights[BlackIx].Data;
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-      Acc[0].Data[i] += WhiteAdd[i];
-      Acc[1].Data[i] += BlackAdd[i];
-    }
+  /// How far back a repetition could be
+  [[nodiscard]] int repetitionPlies(const KeyHistory &History) const {
+    return std::min({static_cast<int>(Hmc), static_cast<int>(PliesFromNull),
+                     History.size()});
+  }
+
+  void saveState(StateInfo &State) const {
+    State.Hash = Hash;
+    State.EpSq = EpSq;
+    State.Rights = Rights;
+    State.Hmc = Hmc;
+    State.PliesFromNull = PliesFromNull;
+    State.Checkers = Checkers;
+    State.Pinned = Pinned;
+    State.Captured = Piece::None;
   }
 
-  void nnueSub(Piece Pc, Color Col, Square Sq) {
-    const auto [WhiteIx, BlackIx] = nnueIdx(Col, Pc, Sq);
-    const auto &WhiteSub = NNUE.InputWeights[WhiteIx].Data;
-    const auto &BlackSub = NNUE.InputWeights[BlackIx].Data;
-    for (int i = 0; i < HIDDEN_SIZE; i++) {
-      Acc[0].Data[i] -= WhiteSub[i];
-      Acc[1].Data[i] -= BlackSub[i];
+  void restoreState(const StateInfo &State) {
+    Hash = State.Hash;
+    EpSq = State.EpSq;
+    Rights = State.Rights;
+    Hmc = State.Hmc;
+    PliesFromNull = State.PliesFromNull;
+    Checkers = State.Checkers;
+    Pinned = State.Pinned;
+  }
+
+  [[nodiscard]] Square kingSq() const {
+    return getBB(Piece::King, Stm).lsb();
+  }
+
+  /// Find the checkers and pinned pieces of the side to move
+  void updateChecks();
+
+  /// Squares a piece can move to without leaving its king in check,
+  /// apart from the king itself and en passant
+  [[nodiscard]] Bitboard legalTargets(Square From) const {
+    // Evasions:
+    // Capture the checker or block it, the king has to move
+    // when there are two of them
+    Bitboard Targets = ~0ULL;
+    if (Checkers)
+      Targets = Checkers.popcnt() > 1
+                    ? Bitboard(0)
+                    : getBetweenSq(kingSq(), Checkers.lsb()) | Checkers;
+
+    // Pinned pieces move along the pin only
+    if (Pinned.getBit(From))
+      Targets &= getLineSq(kingSq(), From);
+
+    return Targets;
+  }
+
+  /// Squares the king can move to, not counting castling
+  [[nodiscard]] Bitboard kingTargets() const;
+
+  /// Whether an en passant capture leaves the king safe
+  [[nodiscard]] bool isLegalEP(Square From) const;
+
+  /// Switch side to move and remove existing en passant square
+  void changeSide() {
+    // En passant square expired
+    if (EpSq.exists()) {
+      updateHash(getEPKey(EpSq));
+      EpSq = Square::None;
     }
+
+    ++Hmc;
+    ++PliesFromNull;
+
+    Stm = Stm.inverse();
+    updateHash(getStmKey());
+  }
+
+  // Board only updates for taking moves back, the hash is restored whole
+
+  void putPiece(Piece Pc, Color Col, Square Sq) {
+    Pieces[Pc].set(Sq);
+    Colors[Col].set(Sq);
   }
 
+  void takePiece(Piece Pc, Color Col, Square Sq) {
+    Pieces[Pc].pop(Sq);
+    Colors[Col].pop(Sq);
+  }
+
+  // Board and hash updates, the accumulators are updated lazily
+  // from the dirty pieces
+
   void addPiece(Piece Pc, Color Col, Square Sq) {
     Pieces[Pc].set(Sq);
     Colors[Col].set(Sq);
 
     updateHash(getPieceKey(Pc, Sq));
     updateHash(getColorKey(Col, Sq));
-
-    nnueAdd(Pc, Col, Sq);
   }
 
   void clearPiece(Piece Pc, Color Col, Square Sq) {
@@ -161,8 +261,6 @@ private:
 
     updateHash(getPieceKey(Pc, Sq));
     updateHash(getColorKey(Col, Sq));
-
-    nnueSub(Pc, Col, Sq);
   }
 
   void movePiece(Piece Pc, Color Col, Square From, Square To) {
@@ -25,7 +25,7 @@ uint64_t pali::getCastleKey(uint8_t Rights) { return CASTLE_KEYS[Rights]; }
 
 uint64_t pali::getStmKey() { return STM_KEY; }
 
-std::mt19937_64 randHash(0x123456789);
+std::mt19937_64 randHash(ZOBRIST_SEED);
 
 void pali::initZobrist() {
   for (int Sq = 0; Sq < 64; ++Sq) {
@@ -8,6 +8,10 @@
 
 namespace pali {
 
+/// Seed of the generator of every Zobrist key, hashes from builds with
+/// different seeds can't be compared
+constexpr uint64_t ZOBRIST_SEED = 0x123456789;
+
 /// Initialize Zobrist keys
 void initZobrist();
 
@@ -0,0 +1,139 @@
+#include "nnue/AccumulatorStack.h"
+
+#include "core/Bitboard.h"
+#include "core/Color.h"
+#include "core/Piece.h"
+#include "core/Position.h"
+#include "nnue/Network.h"
+#include "nnue/Simd.h"
+
+#include <cstdint>
+
+using namespace pali;
+
+AccumulatorStack::AccumulatorStack()
+    : Stack(CAPACITY), RefreshTable(KING_BUCKETS) {
+  clearRefreshTable();
+}
+
+void AccumulatorStack::clearRefreshTable() {
+  for (auto &Entries : RefreshTable)
+    for (RefreshEntry &Entry : Entries)
+      Entry = {NNUE->InputBias, {}};
+}
+
+void AccumulatorStack::reset(const Position &Pos) {
+  Height = 0;
+
+  for (Color Perspective : {Color::White, Color::Black}) {
+    Stack[0].Kings[Perspective] = Pos.getBB(Piece::King, Perspective).lsb();
+    refresh(Pos, Perspective);
+  }
+}
+
+void AccumulatorStack::push(const DirtyPieces &Dirty) {
+  const Entry &Parent = Stack[Height];
+  Entry &Top = Stack[++Height];
+
+  Top.Dirty = Dirty;
+  Top.Kings = Parent.Kings;
+  Top.Computed = {};
+  Top.NeedsRefresh = {};
+
+  // King moves might change the mover's king bucket
+  const DirtyPiece &Moved = Dirty.Removed[0];
+  if (Moved.Pc == Piece::King) {
+    const Square To = Dirty.Added[0].Sq;
+    Top.Kings[Moved.Col] = To;
+    Top.NeedsRefresh[Moved.Col] = needsRefresh(Moved.Col, Moved.Sq, To);
+  }
+}
+
+int AccumulatorStack::evaluate(const Position &Pos) {
+  catchUp(Pos, Color::White);
+  catchUp(Pos, Color::Black);
+
+  const auto &Acc = Stack[Height].Acc;
+  return pali::evaluate(Acc[Pos.stm()], Acc[Pos.stm().inverse()],
+                        outputBucket(Pos.allBB().popcnt()));
+}
+
+void AccumulatorStack::catchUp(const Position &Pos, Color Perspective) {
+  // Find the nearest computed ancestor
+  int Computed = Height;
+  while (!Stack[Computed].Computed[Perspective]) {
+    // The king changed bucket on the way, the ancestors are no use
+    if (Stack[Computed].NeedsRefresh[Perspective]) {
+      refresh(Pos, Perspective);
+      return;
+    }
+
+    --Computed;
+  }
+
+  for (int i = Computed + 1; i <= Height; ++i)
+    update(Stack[i], Stack[i - 1], Perspective);
+}
+
+void AccumulatorStack::update(Entry &Child, const Entry &Parent,
+                              Color Perspective) {
+  const DirtyPieces &Dirty = Child.Dirty;
+  const Square King = Child.Kings[Perspective];
+
+  const auto weights = [Perspective, King](const DirtyPiece &Dp) {
+    return inputWeights(featureIdx(Perspective, King, Dp.Col, Dp.Pc, Dp.Sq));
+  };
+
+  int16_t *Dst = Child.Acc[Perspective].Data.data();
+  const int16_t *Src = Parent.Acc[Perspective].Data.data();
+
+  // Castling
+  if (Dirty.NumAdded == 2)
+    simd::addAddSubSub(Dst, Src, weights(Dirty.Added[0]),
+                       weights(Dirty.Added[1]), weights(Dirty.Removed[0]),
+                       weights(Dirty.Removed[1]));
+
+  // Captures
+  else if (Dirty.NumRemoved == 2)
+    simd::addSubSub(Dst, Src, weights(Dirty.Added[0]),
+                    weights(Dirty.Removed[0]), weights(Dirty.Removed[1]));
+
+  // Quiet moves
+  else
+    simd::addSub(Dst, Src, weights(Dirty.Added[0]), weights(Dirty.Removed[0]));
+
+  Child.Computed[Perspective] = true;
+}
+
+void AccumulatorStack::refresh(const Position &Pos, Color Perspective) {
+  Entry &Top = Stack[Height];
+  const Square King = Top.Kings[Perspective];
+  RefreshEntry &Cached =
+      RefreshTable[kingBucket(Perspective, King)][Perspective];
+
+  int16_t *Data = Cached.Acc.Data.data();
+
+  for (Color Col : {Color::White, Color::Black}) {
+    for (int Pc = Piece::Pawn; Pc <= Piece::King; ++Pc) {
+      const Bitboard PiecesBB = Pos.getBB(static_cast<Piece::Type>(Pc), Col);
+      const Bitboard CachedBB = Cached.Pieces[Col][Pc];
+
+      // Only apply the difference from the last time this bucket was used
+      Bitboard Added = PiecesBB & ~CachedBB;
+      Bitboard Removed = CachedBB & ~PiecesBB;
+
+      while (Added)
+        simd::add(Data, inputWeights(featureIdx(Perspective, King, Col, Pc,
+                                                Added.takeLsb())));
+
+      while (Removed)
+        simd::sub(Data, inputWeights(featureIdx(Perspective, King, Col, Pc,
+                                                Removed.takeLsb())));
+
+      Cached.Pieces[Col][Pc] = PiecesBB;
+    }
+  }
+
+  Top.Acc[Perspective] = Cached.Acc;
+  Top.Computed[Perspective] = true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "core/Bitboard.h"
+#include "core/Color.h"
+#include "core/Piece.h"
+#include "core/Square.h"
+#include "nnue/Network.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace pali {
+
+class Position;
+
+/// A piece feature toggled by a move
+struct DirtyPiece {
+  Piece Pc;
+  Color Col;
+  Square Sq;
+};
+
+/// Features changed by a move
+/// A move adds at most 2 pieces (castling)
+/// and removes at most 2 (captures and castling),
+/// the moved piece always comes first
+struct DirtyPieces {
+  std::array<DirtyPiece, 2> Added;
+  std::array<DirtyPiece, 2> Removed;
+  uint8_t NumAdded = 0;
+  uint8_t NumRemoved = 0;
+
+  void add(Piece Pc, Color Col, Square Sq) {
+    Added[NumAdded++] = {Pc, Col, Sq};
+  }
+
+  void remove(Piece Pc, Color Col, Square Sq) {
+    Removed[NumRemoved++] = {Pc, Col, Sq};
+  }
+
+  void clear() { NumAdded = NumRemoved = 0; }
+};
+
+/// Per-thread stack of accumulators with one entry for each move made
+/// from the root.
+/// Making a move only records its dirty pieces, the accumulators are brought
+/// up to date from the nearest computed ancestor when the position
+/// is actually evaluated, so pruned nodes never pay for NNUE updates.
+class AccumulatorStack {
+  struct Entry {
+    std::array<Accumulator, 2> Acc;
+    DirtyPieces Dirty;
+    std::array<Square, 2> Kings;
+    std::array<bool, 2> Computed = {};
+    /// The move crossed a king bucket, so it can't be applied incrementally
+    std::array<bool, 2> NeedsRefresh = {};
+  };
+
+  /// Finny table entry: the last accumulator computed for a king bucket
+  /// and the pieces it was computed from, so a refresh only has to apply
+  /// the difference with the current board
+  struct RefreshEntry {
+    Accumulator Acc;
+    std::array<std::array<Bitboard, 6>, 2> Pieces = {};
+  };
+
+  std::vector<Entry> Stack;
+  int Height = 0;
+
+  /// Indexed by [king bucket][perspective]
+  std::vector<std::array<RefreshEntry, 2>> RefreshTable;
+
+public:
+  /// Enough for a full length main search line followed by qsearch captures
+  static constexpr int CAPACITY = 256;
+
+  AccumulatorStack();
+
+  /// Compute the accumulators of the root position
+  void reset(const Position &Pos);
+
+  /// Forget the accumulators cached for each king bucket,
+  /// needed when the network changes
+  void clearRefreshTable();
+
+  /// Record a move made on top of the current position
+  void push(const DirtyPieces &Dirty);
+
+  /// Take back the last move
+  void pop() { --Height; }
+
+  /// Evaluate the position on top of the stack,
+  /// applying pending updates first
+  [[nodiscard]] int evaluate(const Position &Pos);
+
+private:
+  /// Bring the perspective's accumulator on top of the stack up to date
+  void catchUp(const Position &Pos, Color Perspective);
+
+  /// Compute an accumulator from its parent and its dirty pieces
+  static void update(Entry &Child, const Entry &Parent, Color Perspective);
+
+  /// Compute the accumulator on top of the stack from the refresh table
+  void refresh(const Position &Pos, Color Perspective);
+};
+
+} // namespace pali
@@ -0,0 +1,70 @@
+#include "nnue/BatchEval.h"
+
+#include "core/Bitboard.h"
+#include "core/Color.h"
+#include "core/Piece.h"
+#include "core/Position.h"
+#include "nnue/Network.h"
+#include "nnue/Simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+using namespace pali;
+
+BatchEvaluator::BatchEvaluator() : Accs(BATCH_SIZE) {
+  // At most 32 pieces each
+  Rows.reserve(BATCH_SIZE * 32);
+}
+
+void BatchEvaluator::evaluate(std::span<const Position> Positions,
+                              std::span<int> Evals) {
+  for (std::size_t Start = 0; Start < Positions.size(); Start += BATCH_SIZE) {
+    const std::size_t Count =
+        std::min<std::size_t>(BATCH_SIZE, Positions.size() - Start);
+    const std::span<const Position> Batch = Positions.subspan(Start, Count);
+
+    refresh(Batch);
+
+    for (std::size_t i = 0; i < Count; ++i) {
+      const Position &Pos = Batch[i];
+      Evals[Start + i] =
+          pali::evaluate(Accs[i][Pos.stm()], Accs[i][Pos.stm().inverse()],
+                         outputBucket(Pos.allBB().popcnt()));
+    }
+  }
+}
+
+void BatchEvaluator::refresh(std::span<const Position> Batch) {
+  std::array<int16_t *, BATCH_SIZE> Targets;
+
+  for (Color Perspective : {Color::White, Color::Black}) {
+    Rows.clear();
+
+    for (std::size_t i = 0; i < Batch.size(); ++i) {
+      const Position &Pos = Batch[i];
+      const Square King = Pos.getBB(Piece::King, Perspective).lsb();
+      const std::size_t First = Rows.size();
+
+      for (Color Col : {Color::White, Color::Black}) {
+        for (int Pc = Piece::Pawn; Pc <= Piece::King; ++Pc) {
+          Bitboard PiecesBB = Pos.getBB(static_cast<Piece::Type>(Pc), Col);
+
+          while (PiecesBB)
+            Rows.push_back(inputWeights(
+                featureIdx(Perspective, King, Col, Pc, PiecesBB.takeLsb())));
+        }
+      }
+
+      Targets[i] = Accs[i][Perspective].Data.data();
+      RowCounts[i] = Rows.size() - First;
+    }
+
+    simd::refreshBatch(Targets.data(), Batch.size(),
+                       NNUE->InputBias.Data.data(), Rows.data(),
+                       RowCounts.data());
+  }
+}
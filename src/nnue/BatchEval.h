@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core/Position.h"
+#include "nnue/Network.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace pali {
+
+/// Static evaluation of many positions at once.
+/// The accumulators of BATCH_SIZE positions are built together
+/// by simd::refreshBatch(), which sums them in registers and keeps
+/// the rows of input weights shared by the positions in cache
+class BatchEvaluator {
+public:
+  static constexpr int BATCH_SIZE = 32;
+
+  BatchEvaluator();
+
+  /// Evaluate every position from its side to move's point of view,
+  /// Evals must be as long as Positions
+  void evaluate(std::span<const Position> Positions, std::span<int> Evals);
+
+private:
+  /// Build both accumulators of every position of the batch
+  void refresh(std::span<const Position> Batch);
+
+  std::vector<std::array<Accumulator, 2>> Accs;
+
+  /// Rows of input weights of every position of the batch
+  std::vector<const int16_t *> Rows;
+  std::array<int, BATCH_SIZE> RowCounts;
+};
+
+} // namespace pali
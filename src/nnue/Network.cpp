@@ -1,18 +1,387 @@
 #include "nnue/Network.h"
 
-#include <fstream>
-#include <ios>
+#include "core/Memory.h"
+#include "nnue/Simd.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 
 using namespace pali;
 
-Network pali::NNUE;
+// Embed the default network into the binary at build time
+#if defined(__APPLE__)
+#define NET_SYMBOL(Name) "_" #Name
+#define NET_SECTION ".const_data"
+#else
+#define NET_SYMBOL(Name) #Name
+#define NET_SECTION ".section .rodata"
+#endif
+
+asm(NET_SECTION "\n"
+    ".balign 64\n"
+    ".globl " NET_SYMBOL(PaliEmbeddedNetwork) "\n"
+    NET_SYMBOL(PaliEmbeddedNetwork) ":\n"
+    ".incbin \"" EVALFILE "\"\n"
+    ".globl " NET_SYMBOL(PaliEmbeddedNetworkEnd) "\n"
+    NET_SYMBOL(PaliEmbeddedNetworkEnd) ":\n"
+    ".text\n");
+
+extern "C" const uint8_t PaliEmbeddedNetwork[];
+extern "C" const uint8_t PaliEmbeddedNetworkEnd[];
+
+thread_local const Network *pali::NNUE = nullptr;
+
+// Network of every thread not on a NUMA node
+const Network *MainNNUE = nullptr;
+
+const Network *EmbeddedNNUE = nullptr;
+
+// Network picked with EvalFile or the embedded one
+const Network *SourceNNUE = nullptr;
+
+// Memory mapped network file in use, if any
+void *Mapping = nullptr;
+std::size_t MappingSize = 0;
+
+// Copy of the network shared with other processes, if any
+bool UseShared = true;
+SharedMapping Shared;
+
+// Copies of the network on each NUMA node, allocated with allocHuge()
+std::map<int, Network *> Replicas;
+std::mutex ReplicasMutex;
+
+void Accumulator::reset() { Data = NNUE->InputBias.Data; }
+
+/// FNV-1a hash of the network payload
+uint64_t checksum(const uint8_t *Data, std::size_t Size) {
+  uint64_t Hash = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < Size; ++i) {
+    Hash ^= Data[i];
+    Hash *= 0x100000001b3;
+  }
+
+  return Hash;
+}
+
+/// Check the weights fit the evaluation, return nullptr if they don't
+const Network *checkWeights(const Network *Net, std::string &Error) {
+  if constexpr (!LAYERED) {
+    // The SIMD screluDot() needs clamp(x) * w to fit into 16 bits
+    for (const auto &Weights : Net->Output.Weights)
+      for (const Accumulator &Acc : Weights)
+        for (int16_t W : Acc.Data)
+          if (W < -127 || W > 127) {
+            Error = "output weights are outside of [-127, 127]";
+            return nullptr;
+          }
+  }
+
+  return Net;
+}
+
+/// Locate the network inside a file and check it can be used,
+/// return nullptr if it can't
+const Network *parseNetwork(const uint8_t *Data, std::size_t Size,
+                            std::string &Error) {
+  // Raw network straight from the trainer
+  if (Size == sizeof(Network))
+    return checkWeights(reinterpret_cast<const Network *>(Data), Error);
+
+  if (Size < sizeof(NetworkHeader)) {
+    Error = "file is too small";
+    return nullptr;
+  }
+
+  NetworkHeader Header;
+  std::memcpy(&Header, Data, sizeof(NetworkHeader));
+
+  if (std::memcmp(Header.Magic.data(), "PALINNUE", 8) != 0) {
+    Error = "not a Pali network";
+    return nullptr;
+  }
+
+  if (Header.Version == 0 || Header.Version > NETWORK_VERSION) {
+    Error = "unsupported network version " + std::to_string(Header.Version);
+    return nullptr;
+  }
+
+  // Fields added by later versions
+  if (Header.Version < 2)
+    Header.OutputBuckets = 1;
+
+  if (Header.Version < 3)
+    Header.L2Size = Header.L3Size = 0;
+
+  if (Header.InputSize != INPUT_SIZE || Header.HiddenSize != HIDDEN_SIZE ||
+      Header.InputBuckets != INPUT_BUCKETS || Header.Mirrored != MIRRORED ||
+      Header.OutputBuckets != OUTPUT_BUCKETS ||
+      Header.L2Size != (LAYERED ? L2_SIZE : 0) ||
+      Header.L3Size != (LAYERED ? L3_SIZE : 0)) {
+    Error = "network architecture doesn't match the engine";
+    return nullptr;
+  }
+
+  if (Header.PayloadSize != sizeof(Network) ||
+      Size != sizeof(NetworkHeader) + Header.PayloadSize) {
+    Error = "unexpected network size";
+    return nullptr;
+  }
+
+  const uint8_t *Payload = Data + sizeof(NetworkHeader);
+
+  if (checksum(Payload, Header.PayloadSize) != Header.Checksum) {
+    Error = "checksum mismatch, the file is corrupted";
+    return nullptr;
+  }
+
+  return checkWeights(reinterpret_cast<const Network *>(Payload), Error);
+}
+
+/// Copy the network into a segment shared by every Pali process
+/// using the same network, return nullptr if it isn't possible
+const Network *shareNetwork(const Network *Net) {
+  const uint8_t *Payload = reinterpret_cast<const uint8_t *>(Net);
+
+  NetworkHeader Header{};
+  std::memcpy(Header.Magic.data(), "PALINNUE", 8);
+  Header.Version = NETWORK_VERSION;
+  Header.InputSize = INPUT_SIZE;
+  Header.HiddenSize = HIDDEN_SIZE;
+  Header.InputBuckets = INPUT_BUCKETS;
+  Header.Mirrored = MIRRORED;
+  Header.OutputBuckets = OUTPUT_BUCKETS;
+  Header.L2Size = LAYERED ? L2_SIZE : 0;
+  Header.L3Size = LAYERED ? L3_SIZE : 0;
+  Header.PayloadSize = sizeof(Network);
+  Header.Checksum = checksum(Payload, sizeof(Network));
+
+  // Identical networks end up in the same segment
+  char Name[32];
+  std::snprintf(Name, sizeof(Name), "pali-nnue-%016llx",
+                static_cast<unsigned long long>(Header.Checksum));
+
+  const std::size_t Size = sizeof(NetworkHeader) + sizeof(Network);
+
+  SharedMapping NewShared;
+  bool Mapped = mapShared(
+      Name, Size,
+      [&Header, Payload](uint8_t *Dst) {
+        std::memcpy(Dst, &Header, sizeof(NetworkHeader));
+        std::memcpy(Dst + sizeof(NetworkHeader), Payload, sizeof(Network));
+      },
+      NewShared);
+
+  if (!Mapped)
+    return nullptr;
+
+  // Don't trust a segment left behind by someone else blindly,
+  // it has to hold this very network and not just any valid one
+  std::string Error;
+  const Network *SharedNet = parseNetwork(NewShared.Data, Size, Error);
+  if (SharedNet == nullptr ||
+      std::memcmp(SharedNet, Net, sizeof(Network)) != 0) {
+    unmapShared(NewShared);
+    return nullptr;
+  }
+
+  unmapShared(Shared);
+  Shared = NewShared;
+
+  return SharedNet;
+}
+
+void freeReplicas() {
+  std::lock_guard Lock(ReplicasMutex);
+
+  for (auto &[Node, Replica] : Replicas)
+    freeHuge(Replica, sizeof(Network));
+
+  Replicas.clear();
+}
+
+/// Point NNUE at the shared copy of the source network if possible
+void placeNetwork() {
+  const Network *SharedNet = UseShared ? shareNetwork(SourceNNUE) : nullptr;
+
+  if (SharedNet == nullptr)
+    unmapShared(Shared);
+
+  // Copies of the old network, threads pick the new one up in useNNUE()
+  freeReplicas();
+
+  MainNNUE = SharedNet ? SharedNet : SourceNNUE;
+  NNUE = MainNNUE;
+}
+
+void pali::useNNUE(int Node) {
+  if (Node < 0) {
+    NNUE = MainNNUE;
+    return;
+  }
+
+  std::lock_guard Lock(ReplicasMutex);
+
+  Network *&Replica = Replicas[Node];
+
+  if (Replica == nullptr) {
+    Replica = static_cast<Network *>(allocHuge(sizeof(Network)));
+
+    // Fall back to the network itself, remote weights beat no weights
+    if (Replica == nullptr) {
+      Replicas.erase(Node);
+      NNUE = MainNNUE;
+      return;
+    }
+
+    std::memcpy(static_cast<void *>(Replica), MainNNUE, sizeof(Network));
+  }
+
+  NNUE = Replica;
+}
+
+void unmapNetwork() {
+  if (Mapping)
+    munmap(Mapping, MappingSize);
+
+  Mapping = nullptr;
+  MappingSize = 0;
+}
+
+void pali::initNNUE() {
+  std::string Error;
+  EmbeddedNNUE = parseNetwork(PaliEmbeddedNetwork,
+                              PaliEmbeddedNetworkEnd - PaliEmbeddedNetwork,
+                              Error);
+
+  // Never play with garbage weights
+  if (EmbeddedNNUE == nullptr) {
+    std::cout << "info string embedded network is invalid: " << Error
+              << std::endl;
+    std::exit(1);
+  }
+
+  SourceNNUE = EmbeddedNNUE;
+  placeNetwork();
+
+  if (Shared.Data)
+    std::cout << "info string network shared at " << Shared.Path
+              << ", huge pages: "
+              << (isHugePageBacked(Shared.Data) ? "yes" : "no") << std::endl;
+  else
+    std::cout << "info string network not shared" << std::endl;
+}
+
+void pali::setSharedNNUE(bool Enabled) {
+  UseShared = Enabled;
+  placeNetwork();
+}
+
+bool pali::loadNNUE(const std::string &Path, std::string &Error) {
+  if (Path.empty() || Path == "<empty>") {
+    SourceNNUE = EmbeddedNNUE;
+    placeNetwork();
+    unmapNetwork();
+    return true;
+  }
+
+  int Fd = open(Path.c_str(), O_RDONLY);
+  if (Fd < 0) {
+    Error = "can't open " + Path;
+    return false;
+  }
+
+  struct stat Stat;
+  if (fstat(Fd, &Stat) != 0 || Stat.st_size == 0) {
+    close(Fd);
+    Error = "can't read " + Path;
+    return false;
+  }
+
+  // Map the file read only and shared, so every engine process
+  // using the same file shares the page cache instead of copying weights
+  const std::size_t Size = Stat.st_size;
+  void *Data = mmap(nullptr, Size, PROT_READ, MAP_SHARED, Fd, 0);
+  close(Fd);
+
+  if (Data == MAP_FAILED) {
+    Error = "can't map " + Path;
+    return false;
+  }
+
+  madvise(Data, Size, MADV_WILLNEED);
+
+  const Network *Net =
+      parseNetwork(static_cast<const uint8_t *>(Data), Size, Error);
+  if (Net == nullptr) {
+    munmap(Data, Size);
+    return false;
+  }
+
+  SourceNNUE = Net;
+  placeNetwork();
+
+  unmapNetwork();
+  Mapping = Data;
+  MappingSize = Size;
+
+  return true;
+}
+
+int pali::evaluate(const Accumulator &Us, const Accumulator &Them,
+                   int Bucket) {
+  return evaluateOutput(NNUE->Output, Us, Them, Bucket);
+}
+
+int pali::evaluateOutput(const OutputLayer &Output, const Accumulator &Us,
+                         const Accumulator &Them, int Bucket) {
+  const auto &Weights = Output.Weights[Bucket];
+
+  // Need to be 32 bits to avoid overflow
+  int32_t Sum =
+      simd::screluDot(Us.Data.data(), Them.Data.data(),
+                      Weights[0].Data.data(), Weights[1].Data.data());
+
+  Sum /= QA;
+
+  Sum += Output.Bias[Bucket];
+
+  return Sum * SCALE / QAB;
+}
+
+int pali::evaluateOutput(const DenseOutput &Output, const Accumulator &Us,
+                         const Accumulator &Them, int Bucket) {
+  const DenseLayers &Layers = Output[Bucket];
+
+  alignas(64) std::array<uint8_t, L1_SIZE> L1Input;
+  simd::activateL1(Us.Data.data(), Them.Data.data(), L1Input.data());
+
+  // Most activations are clipped to zero, skip the groups of 4 that are
+  alignas(64) std::array<uint16_t, L1_SIZE / 4> NonZero;
+  const int Count = simd::findNonZero(L1Input.data(), NonZero.data());
+
+  alignas(64) std::array<int32_t, L2_SIZE> L1Output;
+  simd::sparseAffine(L1Input.data(), NonZero.data(), Count,
+                     Layers.L1Weights.data(), Layers.L1Bias.data(),
+                     L1Output.data());
 
-void Accumulator::reset() { Data = NNUE.InputBias.Data; }
+  const float Sum =
+      simd::denseForward(L1Output.data(), Layers.L2Weights.data(),
+                         Layers.L2Bias.data(), Layers.L3Weights.data()) +
+      Layers.L3Bias;
 
-void pali::initNNUE(std::string Path) {
-  std::ifstream(Path.substr(0, Path.find_last_of("/")) +
-                    "/../resources/jigglypuff.nnue",
-                std::ios::binary)
-      .read(reinterpret_cast<char *>(&NNUE), sizeof(Network));
+  return static_cast<int>(Sum * SCALE);
 }
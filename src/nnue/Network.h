@@ -4,46 +4,203 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
-#include <utility>
+#include <type_traits>
 
 namespace pali {
 
-using NNUEIndices = std::pair<std::size_t, std::size_t>;
-
 constexpr int INPUT_SIZE = 768;
 constexpr int HIDDEN_SIZE = 256;
 
+/// Number of king buckets, each one has its own set of input weights
+constexpr int INPUT_BUCKETS = 1;
+
+/// Mirror features horizontally when the king is on files e-h
+constexpr bool MIRRORED = false;
+
+// clang-format off
+/// King bucket for each square, from the perspective's own side:
+/// the first row is the perspective's back rank
+constexpr std::array<uint8_t, 64> BUCKET_LAYOUT{
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0,
+};
+// clang-format on
+
+/// Number of output buckets, picked by the number of pieces on the board
+constexpr int OUTPUT_BUCKETS = 1;
+
+/// Number of distinct king placements needing their own accumulator:
+/// every bucket, twice if features are mirrored
+constexpr int KING_BUCKETS = INPUT_BUCKETS * (MIRRORED ? 2 : 1);
+
+/// Put dense layers between the accumulators and the output,
+/// the shipped network feeds the accumulators straight into the output
+constexpr bool LAYERED = false;
+
+/// Sizes of the dense layers: both accumulators -> L2 -> L3 -> 1
+constexpr int L1_SIZE = 2 * HIDDEN_SIZE;
+constexpr int L2_SIZE = 16;
+constexpr int L3_SIZE = 32;
+
 constexpr int SCALE = 400;
 constexpr int QA = 255;
 constexpr int QB = 64;
 constexpr int QAB = QA * QB;
 
-struct Accumulator {
+/// L1 inputs are SCReLU activations squeezed into a byte, QL1_IN being 1.0
+constexpr int QL1_IN = 127;
+
+/// Quantisation of the int8 L1 weights, the later layers are float
+constexpr int QL1 = 64;
+
+struct alignas(64) Accumulator {
   std::array<int16_t, HIDDEN_SIZE> Data;
 
   /// Set to input bias
   void reset();
 };
 
+/// Output layer reading the accumulators directly
+struct OutputLayer {
+  std::array<std::array<Accumulator, 2>, OUTPUT_BUCKETS> Weights;
+  std::array<int16_t, OUTPUT_BUCKETS> Bias;
+};
+
+/// Dense layers of one output bucket, every array starts on a cache line
+struct DenseLayers {
+  /// Grouped by 4 consecutive inputs so the sparse product reads
+  /// one contiguous row per non-zero group: [L1_SIZE / 4][L2_SIZE][4]
+  alignas(64) std::array<int8_t, L1_SIZE * L2_SIZE> L1Weights;
+  alignas(64) std::array<int32_t, L2_SIZE> L1Bias;
+  alignas(64) std::array<float, L2_SIZE * L3_SIZE> L2Weights; // [L2][L3]
+  alignas(64) std::array<float, L3_SIZE> L2Bias;
+  alignas(64) std::array<float, L3_SIZE> L3Weights;
+  float L3Bias;
+};
+
+using DenseOutput = std::array<DenseLayers, OUTPUT_BUCKETS>;
+
 struct Network {
-  std::array<Accumulator, INPUT_SIZE> InputWeights;
+  std::array<Accumulator, INPUT_BUCKETS * INPUT_SIZE> InputWeights;
   Accumulator InputBias;
-  std::array<Accumulator, 2> OutputWeights;
-  int16_t OutputBias;
+  std::conditional_t<LAYERED, DenseOutput, OutputLayer> Output;
+};
+
+/// Version 2 added output buckets, version 1 files have a single one.
+/// Version 3 added dense layers, older files have none
+constexpr uint32_t NETWORK_VERSION = 3;
+
+/// Header of Pali network files, the Network follows right after it.
+/// Files without a header are accepted if they have the exact size
+/// of the Network, but can't be checked for corruption
+struct alignas(64) NetworkHeader {
+  std::array<char, 8> Magic; // "PALINNUE"
+  uint32_t Version;
+  uint16_t InputSize;
+  uint16_t HiddenSize;
+  uint8_t InputBuckets;
+  uint8_t Mirrored;
+  uint8_t OutputBuckets;
+  uint16_t L2Size; // 0 without dense layers
+  uint16_t L3Size;
+  uint64_t PayloadSize;
+  uint64_t Checksum; // FNV-1a of the payload
 };
 
-extern Network NNUE;
+static_assert(sizeof(NetworkHeader) == 64);
 
-void initNNUE(std::string Path);
+/// Network used for evaluation by the calling thread, it points straight
+/// into the embedded or memory mapped file so the weights are never copied,
+/// or into a copy on the thread's NUMA node, see useNNUE()
+extern thread_local const Network *NNUE;
+
+/// Point NNUE of the calling thread at the copy of the network on the
+/// NUMA node, or at the network itself for node -1.
+/// Copies are made by the first thread of a node asking for one
+/// so their pages are local to it, and dropped when the network changes
+void useNNUE(int Node);
+
+/// Use the network embedded into the binary
+/// and report where it was placed
+void initNNUE();
+
+/// Memory map a network file and use it if it is valid,
+/// otherwise keep the current network and describe the problem in Error.
+/// An empty path switches back to the embedded network
+bool loadNNUE(const std::string &Path, std::string &Error);
+
+/// Whether to keep the network in a huge page backed segment shared
+/// by every Pali process using the same network, on by default
+void setSharedNNUE(bool Enabled);
+
+/// Output bucket for the number of pieces on the board
+inline int outputBucket(int PieceCount) {
+  constexpr int DIVISOR = (32 + OUTPUT_BUCKETS - 1) / OUTPUT_BUCKETS;
+  return (PieceCount - 2) / DIVISOR;
+}
+
+/// Run the output layer on the accumulators
+/// from the side to move's and the opponent's perspectives,
+/// only the weights of the given output bucket are touched
+[[nodiscard]] int evaluate(const Accumulator &Us, const Accumulator &Them,
+                           int Bucket);
+
+// Both kinds of output layers, usable with weights outside of the network
+// to compare their speed
+
+[[nodiscard]] int evaluateOutput(const OutputLayer &Output,
+                                 const Accumulator &Us, const Accumulator &Them,
+                                 int Bucket);
+
+/// The first dense layer only reads the groups of inputs
+/// that aren't all zero
+[[nodiscard]] int evaluateOutput(const DenseOutput &Output,
+                                 const Accumulator &Us, const Accumulator &Them,
+                                 int Bucket);
+
+/// Row of input weights for the given feature index
+inline const int16_t *inputWeights(std::size_t Idx) {
+  return NNUE->InputWeights[Idx].Data.data();
+}
+
+/// Square seen from the perspective's side, own back rank first
+inline int relativeSq(int Perspective, int Sq) {
+  return Perspective == 0 ? Sq ^ 0b111'000 : Sq;
+}
+
+/// Whether the features are mirrored with the perspective's king on KingSq
+inline bool isMirrored(int KingSq) { return MIRRORED && (KingSq & 7) >= 4; }
+
+/// Bucket and mirroring combined, every king bucket
+/// needs its own accumulator
+inline int kingBucket(int Perspective, int KingSq) {
+  return BUCKET_LAYOUT[relativeSq(Perspective, KingSq)] * (MIRRORED ? 2 : 1) +
+         isMirrored(KingSq);
+}
+
+/// Whether moving the perspective's king invalidates its accumulator
+inline bool needsRefresh(int Perspective, int From, int To) {
+  return kingBucket(Perspective, From) != kingBucket(Perspective, To);
+}
 
-inline std::pair<std::size_t, std::size_t> nnueIdx(int Col, int Pc, int Sq) {
+/// Index of a piece feature from one perspective,
+/// KingSq is the square of the perspective's own king
+inline std::size_t featureIdx(int Perspective, int KingSq, int Col, int Pc,
+                              int Sq) {
   constexpr std::size_t COLOR_STRIDE = 64 * 6;
   constexpr std::size_t PIECE_STRIDE = 64;
 
-  auto WhiteIdx = Col * COLOR_STRIDE + Pc * PIECE_STRIDE + (Sq ^ 0b111'000);
-  auto BlackIdx = (Col ^ 1) * COLOR_STRIDE + Pc * PIECE_STRIDE + Sq;
+  const int Bucket = BUCKET_LAYOUT[relativeSq(Perspective, KingSq)];
+  const int RelSq = relativeSq(Perspective, Sq) ^ (isMirrored(KingSq) ? 7 : 0);
 
-  return {WhiteIdx, BlackIdx};
+  return Bucket * INPUT_SIZE + (Col != Perspective) * COLOR_STRIDE +
+         Pc * PIECE_STRIDE + RelSq;
 }
 
 } // namespace pali
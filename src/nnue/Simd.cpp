@@ -0,0 +1,184 @@
+#include "nnue/Simd.h"
+
+#include "nnue/Network.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+using namespace pali;
+
+void genericAdd(int16_t *Acc, const int16_t *Add) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i)
+    Acc[i] += Add[i];
+}
+
+void genericSub(int16_t *Acc, const int16_t *Sub) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i)
+    Acc[i] -= Sub[i];
+}
+
+void genericRefreshBatch(int16_t *const *Accs, int Count, const int16_t *Bias,
+                         const int16_t *const *Rows, const int *RowCounts) {
+  for (int j = 0; j < Count; ++j) {
+    std::copy(Bias, Bias + HIDDEN_SIZE, Accs[j]);
+
+    for (int k = 0; k < RowCounts[j]; ++k)
+      genericAdd(Accs[j], *Rows++);
+  }
+}
+
+void genericAddSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                   const int16_t *Sub) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i)
+    Dst[i] = Src[i] + Add[i] - Sub[i];
+}
+
+void genericAddSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                      const int16_t *Sub1, const int16_t *Sub2) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i)
+    Dst[i] = Src[i] + Add[i] - Sub1[i] - Sub2[i];
+}
+
+void genericAddAddSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add1,
+                         const int16_t *Add2, const int16_t *Sub1,
+                         const int16_t *Sub2) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i)
+    Dst[i] = Src[i] + Add1[i] + Add2[i] - Sub1[i] - Sub2[i];
+}
+
+int32_t genericScreluDot(const int16_t *Us, const int16_t *Them,
+                         const int16_t *UsWeights,
+                         const int16_t *ThemWeights) {
+  const auto screlu = [](int16_t x) {
+    constexpr int16_t CR_MIN = 0;
+    constexpr int16_t CR_MAX = QA;
+
+    x = std::clamp(x, CR_MIN, CR_MAX);
+    return static_cast<int32_t>(x) * static_cast<int32_t>(x);
+  };
+
+  int32_t Output = 0; // Need to be 32 bits to avoid overflow
+
+  for (int i = 0; i < HIDDEN_SIZE; ++i) {
+    Output += screlu(Us[i]) * static_cast<int32_t>(UsWeights[i]);
+    Output += screlu(Them[i]) * static_cast<int32_t>(ThemWeights[i]);
+  }
+
+  return Output;
+}
+
+void genericActivateL1(const int16_t *Us, const int16_t *Them, uint8_t *Out) {
+  for (int i = 0; i < HIDDEN_SIZE; ++i) {
+    const int UsClipped = std::clamp<int>(Us[i], 0, QA);
+    const int ThemClipped = std::clamp<int>(Them[i], 0, QA);
+
+    // QA² / 2⁹ is QL1_IN
+    Out[i] = UsClipped * UsClipped >> 9;
+    Out[HIDDEN_SIZE + i] = ThemClipped * ThemClipped >> 9;
+  }
+}
+
+int genericFindNonZero(const uint8_t *Input, uint16_t *Indices) {
+  int Count = 0;
+
+  for (int i = 0; i < L1_SIZE / 4; ++i)
+    if (Input[4 * i] | Input[4 * i + 1] | Input[4 * i + 2] | Input[4 * i + 3])
+      Indices[Count++] = i;
+
+  return Count;
+}
+
+void genericSparseAffine(const uint8_t *Input, const uint16_t *Indices,
+                         int Count, const int8_t *Weights, const int32_t *Bias,
+                         int32_t *Out) {
+  for (int j = 0; j < L2_SIZE; ++j)
+    Out[j] = Bias[j];
+
+  for (int k = 0; k < Count; ++k) {
+    const uint8_t *Group = Input + 4 * Indices[k];
+    const int8_t *Row = Weights + Indices[k] * L2_SIZE * 4;
+
+    for (int j = 0; j < L2_SIZE; ++j)
+      for (int i = 0; i < 4; ++i)
+        Out[j] += Group[i] * Row[4 * j + i];
+  }
+}
+
+float genericDenseForward(const int32_t *Input, const float *L2Weights,
+                          const float *L2Bias, const float *L3Weights) {
+  const auto crelu = [](float x) { return std::clamp(x, 0.0f, 1.0f); };
+
+  alignas(64) std::array<float, L2_SIZE> L2Input;
+  for (int i = 0; i < L2_SIZE; ++i)
+    L2Input[i] = crelu(static_cast<float>(Input[i]) / (QL1_IN * QL1));
+
+  alignas(64) std::array<float, L3_SIZE> L3Input;
+  std::copy(L2Bias, L2Bias + L3_SIZE, L3Input.begin());
+
+  for (int i = 0; i < L2_SIZE; ++i)
+    for (int j = 0; j < L3_SIZE; ++j)
+      L3Input[j] += L2Input[i] * L2Weights[i * L3_SIZE + j];
+
+  // Independent partial sums, floats can't be reordered into a vector sum
+  std::array<float, 8> Sums{};
+  for (int i = 0; i < L3_SIZE; i += 8)
+    for (int k = 0; k < 8; ++k)
+      Sums[k] += crelu(L3Input[i + k]) * L3Weights[i + k];
+
+  float Sum = 0;
+  for (float Partial : Sums)
+    Sum += Partial;
+
+  return Sum;
+}
+
+constexpr simd::Kernels GENERIC_KERNELS{
+    genericAdd,          genericSub,          genericRefreshBatch,
+    genericAddSub,       genericAddSubSub,    genericAddAddSubSub,
+    genericScreluDot,    genericActivateL1,   genericFindNonZero,
+    genericSparseAffine, genericDenseForward};
+
+simd::Kernels simd::Active = GENERIC_KERNELS;
+
+simd::Arch ActiveArch = simd::Arch::Generic;
+
+simd::Kernels simd::getGenericKernels() {
+  return GENERIC_KERNELS;
+}
+
+void simd::initSimd() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    Active = getAVX512Kernels();
+    ActiveArch = Arch::AVX512;
+  }
+
+  else if (__builtin_cpu_supports("avx2")) {
+    Active = getAVX2Kernels();
+    ActiveArch = Arch::AVX2;
+  }
+
+  else if (__builtin_cpu_supports("sse4.1")) {
+    Active = getSSE41Kernels();
+    ActiveArch = Arch::SSE41;
+  }
+#endif
+}
+
+simd::Arch simd::activeArch() { return ActiveArch; }
+
+char const *simd::archName(Arch A) {
+  switch (A) {
+  case Arch::SSE41:
+    return "sse4.1";
+  case Arch::AVX2:
+    return "avx2";
+  case Arch::AVX512:
+    return "avx512";
+  default:
+    return "generic";
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pali::simd {
+
+/// Instruction sets the NNUE kernels are built for
+enum class Arch { Generic, SSE41, AVX2, AVX512 };
+
+/// Table of NNUE kernels for a single instruction set
+/// All pointers must be aligned to 64 bytes, accumulators and their weights
+/// span HIDDEN_SIZE values and dense layer buffers L1_SIZE or L2_SIZE values
+struct Kernels {
+  /// Acc += Add
+  void (*Add)(int16_t *Acc, const int16_t *Add);
+
+  /// Acc -= Sub
+  void (*Sub)(int16_t *Acc, const int16_t *Sub);
+
+  /// Accs[i] = Bias + the sum of its RowCounts[i] rows, the rows of every
+  /// accumulator follow each other in Rows
+  void (*RefreshBatch)(int16_t *const *Accs, int Count, const int16_t *Bias,
+                       const int16_t *const *Rows, const int *RowCounts);
+
+  /// Dst = Src + Add - Sub
+  void (*AddSub)(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                 const int16_t *Sub);
+
+  /// Dst = Src + Add - Sub1 - Sub2
+  void (*AddSubSub)(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                    const int16_t *Sub1, const int16_t *Sub2);
+
+  /// Dst = Src + Add1 + Add2 - Sub1 - Sub2
+  void (*AddAddSubSub)(int16_t *Dst, const int16_t *Src, const int16_t *Add1,
+                       const int16_t *Add2, const int16_t *Sub1,
+                       const int16_t *Sub2);
+
+  /// Sum of SCReLU(Us) * UsWeights + SCReLU(Them) * ThemWeights
+  int32_t (*ScreluDot)(const int16_t *Us, const int16_t *Them,
+                       const int16_t *UsWeights, const int16_t *ThemWeights);
+
+  /// Out = SCReLU(Us) followed by SCReLU(Them), scaled to [0, QL1_IN]
+  void (*ActivateL1)(const int16_t *Us, const int16_t *Them, uint8_t *Out);
+
+  /// Write the indices of the groups of 4 inputs that aren't all zero
+  /// and return how many there are
+  int (*FindNonZero)(const uint8_t *Input, uint16_t *Indices);
+
+  /// Out = Bias + Weights * Input, reading only the groups of 4 inputs
+  /// listed in Indices
+  void (*SparseAffine)(const uint8_t *Input, const uint16_t *Indices,
+                       int Count, const int8_t *Weights, const int32_t *Bias,
+                       int32_t *Out);
+
+  /// Run the float layers on the L1 output and return the final sum
+  /// without the output bias
+  float (*DenseForward)(const int32_t *Input, const float *L2Weights,
+                        const float *L2Bias, const float *L3Weights);
+};
+
+/// Kernels picked by initSimd()
+extern Kernels Active;
+
+/// Detect the best instruction set supported by the CPU
+/// and select the matching kernels
+void initSimd();
+
+/// Instruction set of the selected kernels
+[[nodiscard]] Arch activeArch();
+
+[[nodiscard]] char const *archName(Arch A);
+
+// Per instruction set kernel tables, each one lives in its own translation
+// unit compiled with the matching target flags.
+// Only call them after checking the CPU supports the instruction set.
+[[nodiscard]] Kernels getGenericKernels();
+[[nodiscard]] Kernels getSSE41Kernels();
+[[nodiscard]] Kernels getAVX2Kernels();
+[[nodiscard]] Kernels getAVX512Kernels();
+
+inline void add(int16_t *Acc, const int16_t *Add) { Active.Add(Acc, Add); }
+
+inline void sub(int16_t *Acc, const int16_t *Sub) { Active.Sub(Acc, Sub); }
+
+inline void refreshBatch(int16_t *const *Accs, int Count, const int16_t *Bias,
+                         const int16_t *const *Rows, const int *RowCounts) {
+  Active.RefreshBatch(Accs, Count, Bias, Rows, RowCounts);
+}
+
+inline void addSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                   const int16_t *Sub) {
+  Active.AddSub(Dst, Src, Add, Sub);
+}
+
+inline void addSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+                      const int16_t *Sub1, const int16_t *Sub2) {
+  Active.AddSubSub(Dst, Src, Add, Sub1, Sub2);
+}
+
+inline void addAddSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add1,
+                         const int16_t *Add2, const int16_t *Sub1,
+                         const int16_t *Sub2) {
+  Active.AddAddSubSub(Dst, Src, Add1, Add2, Sub1, Sub2);
+}
+
+[[nodiscard]] inline int32_t screluDot(const int16_t *Us, const int16_t *Them,
+                                       const int16_t *UsWeights,
+                                       const int16_t *ThemWeights) {
+  return Active.ScreluDot(Us, Them, UsWeights, ThemWeights);
+}
+
+inline void activateL1(const int16_t *Us, const int16_t *Them, uint8_t *Out) {
+  Active.ActivateL1(Us, Them, Out);
+}
+
+[[nodiscard]] inline int findNonZero(const uint8_t *Input, uint16_t *Indices) {
+  return Active.FindNonZero(Input, Indices);
+}
+
+inline void sparseAffine(const uint8_t *Input, const uint16_t *Indices,
+                         int Count, const int8_t *Weights, const int32_t *Bias,
+                         int32_t *Out) {
+  Active.SparseAffine(Input, Indices, Count, Weights, Bias, Out);
+}
+
+[[nodiscard]] inline float denseForward(const int32_t *Input,
+                                        const float *L2Weights,
+                                        const float *L2Bias,
+                                        const float *L3Weights) {
+  return Active.DenseForward(Input, L2Weights, L2Bias, L3Weights);
+}
+
+} // namespace pali::simd
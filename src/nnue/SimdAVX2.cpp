@@ -0,0 +1,8 @@
+#if defined(__x86_64__)
+
+#define PALI_AVX2
+#include "nnue/SimdImpl.h"
+
+pali::simd::Kernels pali::simd::getAVX2Kernels() { return KERNELS; }
+
+#endif
@@ -0,0 +1,8 @@
+#if defined(__x86_64__)
+
+#define PALI_AVX512
+#include "nnue/SimdImpl.h"
+
+pali::simd::Kernels pali::simd::getAVX512Kernels() { return KERNELS; }
+
+#endif
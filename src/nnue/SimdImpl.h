@@ -0,0 +1,367 @@
+#pragma once
+
+// Vectorized NNUE kernels shared by every instruction set.
+//
+// This header is included by exactly one translation unit per instruction
+// set (SimdSSE41.cpp, SimdAVX2.cpp, SimdAVX512.cpp), each compiled with its
+// own target flags and defining one of PALI_SSE41, PALI_AVX2 or PALI_AVX512.
+// Everything below has internal linkage so the linker can never substitute
+// an AVX-512 copy of a helper into code running on an older CPU.
+
+#include "nnue/Network.h"
+#include "nnue/Simd.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+using namespace pali;
+
+#if defined(PALI_AVX512)
+
+using Vec = __m512i;
+
+Vec vecLoad(const void *Ptr) { return _mm512_load_si512(Ptr); }
+void vecStore(void *Ptr, Vec V) { _mm512_store_si512(Ptr, V); }
+Vec vecZero() { return _mm512_setzero_si512(); }
+Vec vecSet16(int16_t X) { return _mm512_set1_epi16(X); }
+Vec vecAdd16(Vec A, Vec B) { return _mm512_add_epi16(A, B); }
+Vec vecSub16(Vec A, Vec B) { return _mm512_sub_epi16(A, B); }
+Vec vecMin16(Vec A, Vec B) { return _mm512_min_epi16(A, B); }
+Vec vecMax16(Vec A, Vec B) { return _mm512_max_epi16(A, B); }
+Vec vecMullo16(Vec A, Vec B) { return _mm512_mullo_epi16(A, B); }
+Vec vecMadd16(Vec A, Vec B) { return _mm512_madd_epi16(A, B); }
+Vec vecAdd32(Vec A, Vec B) { return _mm512_add_epi32(A, B); }
+int32_t vecHadd32(Vec V) { return _mm512_reduce_add_epi32(V); }
+Vec vecSet32(int32_t X) { return _mm512_set1_epi32(X); }
+Vec vecShr16(Vec A, int N) { return _mm512_srli_epi16(A, N); }
+Vec vecMaddubs(Vec A, Vec B) { return _mm512_maddubs_epi16(A, B); }
+Vec vecPackU8(Vec A, Vec B) {
+  // packus interleaves A and B in 64-bit blocks, restore their order
+  return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7),
+                                  _mm512_packus_epi16(A, B));
+}
+uint32_t vecNonZero32(Vec V) { return _mm512_test_epi32_mask(V, V); }
+
+#elif defined(PALI_AVX2)
+
+using Vec = __m256i;
+
+Vec vecLoad(const void *Ptr) {
+  return _mm256_load_si256(static_cast<const __m256i *>(Ptr));
+}
+void vecStore(void *Ptr, Vec V) {
+  _mm256_store_si256(static_cast<__m256i *>(Ptr), V);
+}
+Vec vecZero() { return _mm256_setzero_si256(); }
+Vec vecSet16(int16_t X) { return _mm256_set1_epi16(X); }
+Vec vecAdd16(Vec A, Vec B) { return _mm256_add_epi16(A, B); }
+Vec vecSub16(Vec A, Vec B) { return _mm256_sub_epi16(A, B); }
+Vec vecMin16(Vec A, Vec B) { return _mm256_min_epi16(A, B); }
+Vec vecMax16(Vec A, Vec B) { return _mm256_max_epi16(A, B); }
+Vec vecMullo16(Vec A, Vec B) { return _mm256_mullo_epi16(A, B); }
+Vec vecMadd16(Vec A, Vec B) { return _mm256_madd_epi16(A, B); }
+Vec vecAdd32(Vec A, Vec B) { return _mm256_add_epi32(A, B); }
+int32_t vecHadd32(Vec V) {
+  __m128i Sum = _mm_add_epi32(_mm256_castsi256_si128(V),
+                              _mm256_extracti128_si256(V, 1));
+  Sum = _mm_add_epi32(Sum, _mm_shuffle_epi32(Sum, 0b01'00'11'10));
+  Sum = _mm_add_epi32(Sum, _mm_shuffle_epi32(Sum, 0b10'11'00'01));
+  return _mm_cvtsi128_si32(Sum);
+}
+Vec vecSet32(int32_t X) { return _mm256_set1_epi32(X); }
+Vec vecShr16(Vec A, int N) { return _mm256_srli_epi16(A, N); }
+Vec vecMaddubs(Vec A, Vec B) { return _mm256_maddubs_epi16(A, B); }
+Vec vecPackU8(Vec A, Vec B) {
+  // packus interleaves A and B in 64-bit blocks, restore their order
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(A, B), 0b11'01'10'00);
+}
+uint32_t vecNonZero32(Vec V) {
+  const Vec Zero = _mm256_cmpeq_epi32(V, _mm256_setzero_si256());
+  return ~_mm256_movemask_ps(_mm256_castsi256_ps(Zero)) & 0xff;
+}
+
+#elif defined(PALI_SSE41)
+
+using Vec = __m128i;
+
+Vec vecLoad(const void *Ptr) {
+  return _mm_load_si128(static_cast<const __m128i *>(Ptr));
+}
+void vecStore(void *Ptr, Vec V) {
+  _mm_store_si128(static_cast<__m128i *>(Ptr), V);
+}
+Vec vecZero() { return _mm_setzero_si128(); }
+Vec vecSet16(int16_t X) { return _mm_set1_epi16(X); }
+Vec vecAdd16(Vec A, Vec B) { return _mm_add_epi16(A, B); }
+Vec vecSub16(Vec A, Vec B) { return _mm_sub_epi16(A, B); }
+Vec vecMin16(Vec A, Vec B) { return _mm_min_epi16(A, B); }
+Vec vecMax16(Vec A, Vec B) { return _mm_max_epi16(A, B); }
+Vec vecMullo16(Vec A, Vec B) { return _mm_mullo_epi16(A, B); }
+Vec vecMadd16(Vec A, Vec B) { return _mm_madd_epi16(A, B); }
+Vec vecAdd32(Vec A, Vec B) { return _mm_add_epi32(A, B); }
+int32_t vecHadd32(Vec V) {
+  V = _mm_add_epi32(V, _mm_shuffle_epi32(V, 0b01'00'11'10));
+  V = _mm_add_epi32(V, _mm_shuffle_epi32(V, 0b10'11'00'01));
+  return _mm_cvtsi128_si32(V);
+}
+Vec vecSet32(int32_t X) { return _mm_set1_epi32(X); }
+Vec vecShr16(Vec A, int N) { return _mm_srli_epi16(A, N); }
+Vec vecMaddubs(Vec A, Vec B) { return _mm_maddubs_epi16(A, B); }
+Vec vecPackU8(Vec A, Vec B) { return _mm_packus_epi16(A, B); }
+uint32_t vecNonZero32(Vec V) {
+  const Vec Zero = _mm_cmpeq_epi32(V, _mm_setzero_si128());
+  return ~_mm_movemask_ps(_mm_castsi128_ps(Zero)) & 0xf;
+}
+
+#else
+#error "SimdImpl.h included without selecting an instruction set"
+#endif
+
+/// Number of 16-bit lanes in a register
+constexpr int LANES = sizeof(Vec) / sizeof(int16_t);
+
+/// Number of 32-bit lanes in a register
+constexpr int LANES32 = sizeof(Vec) / sizeof(int32_t);
+
+static_assert(HIDDEN_SIZE % (2 * LANES) == 0);
+static_assert(L2_SIZE % LANES32 == 0);
+
+void add(int16_t *Acc, const int16_t *Add) {
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES)
+    vecStore(Acc + i, vecAdd16(vecLoad(Acc + i), vecLoad(Add + i)));
+}
+
+void sub(int16_t *Acc, const int16_t *Sub) {
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES)
+    vecStore(Acc + i, vecSub16(vecLoad(Acc + i), vecLoad(Sub + i)));
+}
+
+/// Accumulators are summed in registers, one tile of TILE registers
+/// at a time so they are stored once instead of after every row.
+/// The whole batch goes through a tile before the next one, so the rows
+/// shared by its positions are still in L1 when another position needs them
+void refreshBatch(int16_t *const *Accs, int Count, const int16_t *Bias,
+                  const int16_t *const *Rows, const int *RowCounts) {
+  constexpr int TILE = std::min(HIDDEN_SIZE / LANES, 8);
+  static_assert(HIDDEN_SIZE % (TILE * LANES) == 0);
+
+  for (int t = 0; t < HIDDEN_SIZE; t += TILE * LANES) {
+    const int16_t *const *Row = Rows;
+
+    for (int j = 0; j < Count; ++j) {
+      Vec Sums[TILE];
+      for (int r = 0; r < TILE; ++r)
+        Sums[r] = vecLoad(Bias + t + r * LANES);
+
+      for (int k = 0; k < RowCounts[j]; ++k, ++Row)
+        for (int r = 0; r < TILE; ++r)
+          Sums[r] = vecAdd16(Sums[r], vecLoad(*Row + t + r * LANES));
+
+      for (int r = 0; r < TILE; ++r)
+        vecStore(Accs[j] + t + r * LANES, Sums[r]);
+    }
+  }
+}
+
+// Fused updates: every lane of the accumulator is loaded once,
+// has all feature deltas applied in registers and is stored once
+
+void addSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+            const int16_t *Sub) {
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES) {
+    Vec V = vecLoad(Src + i);
+    V = vecAdd16(V, vecLoad(Add + i));
+    V = vecSub16(V, vecLoad(Sub + i));
+    vecStore(Dst + i, V);
+  }
+}
+
+void addSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add,
+               const int16_t *Sub1, const int16_t *Sub2) {
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES) {
+    Vec V = vecLoad(Src + i);
+    V = vecAdd16(V, vecLoad(Add + i));
+    V = vecSub16(V, vecLoad(Sub1 + i));
+    V = vecSub16(V, vecLoad(Sub2 + i));
+    vecStore(Dst + i, V);
+  }
+}
+
+void addAddSubSub(int16_t *Dst, const int16_t *Src, const int16_t *Add1,
+                  const int16_t *Add2, const int16_t *Sub1,
+                  const int16_t *Sub2) {
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES) {
+    Vec V = vecLoad(Src + i);
+    V = vecAdd16(V, vecLoad(Add1 + i));
+    V = vecAdd16(V, vecLoad(Add2 + i));
+    V = vecSub16(V, vecLoad(Sub1 + i));
+    V = vecSub16(V, vecLoad(Sub2 + i));
+    vecStore(Dst + i, V);
+  }
+}
+
+/// SCReLU with the madd trick:
+/// clamp(x) * w still fits into 16 bits because the output weights
+/// are within [-127, 127], so multiplying it by clamp(x) once more with madd
+/// gives clamp(x)² * w summed in pairs into 32 bits
+/// at the cost of a single extra multiplication
+int32_t screluDot(const int16_t *Us, const int16_t *Them,
+                  const int16_t *UsWeights, const int16_t *ThemWeights) {
+  const Vec Min = vecZero();
+  const Vec Max = vecSet16(QA);
+
+  Vec Sum = vecZero();
+
+  for (int i = 0; i < HIDDEN_SIZE; i += LANES) {
+    const Vec UsClipped = vecMin16(vecMax16(vecLoad(Us + i), Min), Max);
+    const Vec ThemClipped = vecMin16(vecMax16(vecLoad(Them + i), Min), Max);
+
+    const Vec UsWeighted = vecMullo16(UsClipped, vecLoad(UsWeights + i));
+    const Vec ThemWeighted = vecMullo16(ThemClipped, vecLoad(ThemWeights + i));
+
+    Sum = vecAdd32(Sum, vecMadd16(UsWeighted, UsClipped));
+    Sum = vecAdd32(Sum, vecMadd16(ThemWeighted, ThemClipped));
+  }
+
+  return vecHadd32(Sum);
+}
+
+void activateL1(const int16_t *Us, const int16_t *Them, uint8_t *Out) {
+  const Vec Min = vecZero();
+  const Vec Max = vecSet16(QA);
+
+  // clamp(x)² fits into an unsigned 16-bit lane and QA² / 2⁹ is QL1_IN
+  const auto screlu = [Min, Max](Vec V) {
+    const Vec Clipped = vecMin16(vecMax16(V, Min), Max);
+    return vecShr16(vecMullo16(Clipped, Clipped), 9);
+  };
+
+  for (const int16_t *Acc : {Us, Them}) {
+    for (int i = 0; i < HIDDEN_SIZE; i += 2 * LANES)
+      vecStore(Out + i, vecPackU8(screlu(vecLoad(Acc + i)),
+                                  screlu(vecLoad(Acc + i + LANES))));
+
+    Out += HIDDEN_SIZE;
+  }
+}
+
+/// Offsets of the set bits of every byte, padded to 8 entries
+constexpr auto NON_ZERO_OFFSETS = [] {
+  std::array<std::array<uint16_t, 8>, 256> Offsets{};
+
+  for (int Byte = 0; Byte < 256; ++Byte)
+    for (int Bit = 0, Count = 0; Bit < 8; ++Bit)
+      if (Byte & (1 << Bit))
+        Offsets[Byte][Count++] = Bit;
+
+  return Offsets;
+}();
+
+/// Branchless: each byte of the mask stores all 8 offsets of its set bits
+/// at once and only advances by the number of them, so writes can run up to
+/// 7 entries past the returned count but never past L1_SIZE / 4
+int findNonZero(const uint8_t *Input, uint16_t *Indices) {
+  constexpr int GROUPS = L1_SIZE / 4;
+  static_assert(GROUPS % 8 == 0);
+
+  // 8 groups per byte of mask
+  constexpr int BYTES = LANES32 >= 8 ? LANES32 / 8 : 1;
+  constexpr int STEP = BYTES * 8;
+
+  int Count = 0;
+  __m128i Base = _mm_setzero_si128();
+  const __m128i Eight = _mm_set1_epi16(8);
+
+  for (int i = 0; i < GROUPS; i += STEP) {
+    uint32_t Mask = 0;
+    for (int j = 0; j < STEP; j += LANES32)
+      Mask |= vecNonZero32(vecLoad(Input + 4 * (i + j))) << j;
+
+    for (int b = 0; b < BYTES; ++b) {
+      const uint8_t Byte = Mask >> (8 * b);
+      const __m128i Offsets = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(NON_ZERO_OFFSETS[Byte].data()));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Indices + Count),
+                       _mm_add_epi16(Base, Offsets));
+
+      Count += __builtin_popcount(Byte);
+      Base = _mm_add_epi16(Base, Eight);
+    }
+  }
+
+  return Count;
+}
+
+/// Every non-zero group of 4 inputs is broadcast and multiplied
+/// with its row of weights, maddubs and madd sum the 4 products of each
+/// output into its 32-bit lane. The inputs are within [0, 127]
+/// so the pairs summed by maddubs never saturate
+void sparseAffine(const uint8_t *Input, const uint16_t *Indices, int Count,
+                  const int8_t *Weights, const int32_t *Bias, int32_t *Out) {
+  constexpr int REGISTERS = L2_SIZE / LANES32;
+
+  const Vec Ones = vecSet16(1);
+
+  Vec Sums[REGISTERS];
+  for (int r = 0; r < REGISTERS; ++r)
+    Sums[r] = vecLoad(Bias + r * LANES32);
+
+  for (int k = 0; k < Count; ++k) {
+    int32_t Group;
+    std::memcpy(&Group, Input + 4 * Indices[k], sizeof(Group));
+
+    const Vec In = vecSet32(Group);
+    const int8_t *Row = Weights + Indices[k] * L2_SIZE * 4;
+
+    for (int r = 0; r < REGISTERS; ++r) {
+      const Vec Products = vecMaddubs(In, vecLoad(Row + r * sizeof(Vec)));
+      Sums[r] = vecAdd32(Sums[r], vecMadd16(Products, Ones));
+    }
+  }
+
+  for (int r = 0; r < REGISTERS; ++r)
+    vecStore(Out + r * LANES32, Sums[r]);
+}
+
+/// Plain loops, vectorised by the compiler with this file's target flags
+float denseForward(const int32_t *Input, const float *L2Weights,
+                   const float *L2Bias, const float *L3Weights) {
+  const auto crelu = [](float x) { return std::clamp(x, 0.0f, 1.0f); };
+
+  alignas(64) std::array<float, L2_SIZE> L2Input;
+  for (int i = 0; i < L2_SIZE; ++i)
+    L2Input[i] = crelu(static_cast<float>(Input[i]) / (QL1_IN * QL1));
+
+  alignas(64) std::array<float, L3_SIZE> L3Input;
+  std::copy(L2Bias, L2Bias + L3_SIZE, L3Input.begin());
+
+  for (int i = 0; i < L2_SIZE; ++i)
+    for (int j = 0; j < L3_SIZE; ++j)
+      L3Input[j] += L2Input[i] * L2Weights[i * L3_SIZE + j];
+
+  // Independent partial sums, floats can't be reordered into a vector sum
+  std::array<float, 8> Sums{};
+  for (int i = 0; i < L3_SIZE; i += 8)
+    for (int k = 0; k < 8; ++k)
+      Sums[k] += crelu(L3Input[i + k]) * L3Weights[i + k];
+
+  float Sum = 0;
+  for (float Partial : Sums)
+    Sum += Partial;
+
+  return Sum;
+}
+
+constexpr simd::Kernels KERNELS{add,          sub,          refreshBatch,
+                                 addSub,       addSubSub,    addAddSubSub,
+                                 screluDot,    activateL1,   findNonZero,
+                                 sparseAffine, denseForward};
+
+} // namespace
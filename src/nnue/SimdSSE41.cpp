@@ -0,0 +1,8 @@
+#if defined(__x86_64__)
+
+#define PALI_SSE41
+#include "nnue/SimdImpl.h"
+
+pali::simd::Kernels pali::simd::getSSE41Kernels() { return KERNELS; }
+
+#endif
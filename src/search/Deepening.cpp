@@ -18,6 +18,7 @@ template <bool MAIN> void SearchThread::go(Position &RootPos) {
   uint64_t PrevTimeSpent = 0;
 
   HTable.softReset();
+  Accumulators.reset(RootPos);
 
   // Iterative deepening
   for (int Depth = 1; Depth <= DepthLim; ++Depth) {
@@ -76,6 +77,11 @@ template <bool MAIN> void SearchThread::go(Position &RootPos) {
     }
   }
 
+  EvalCache.addStats(EvalHits, EvalMisses);
+
+  if constexpr (TT_STATS_ENABLED)
+    TTable.addStats(TTStats);
+
   if (MAIN) {
     // If it's forced draw by 50 moves rule then
     // we might not have any move to play
@@ -95,8 +101,7 @@ template <bool MAIN> void SearchThread::go(Position &RootPos) {
   abort();
 }
 
-int SearchThread::aspirationSearch(const Position &RootPos, int Depth,
-                                   int Score) {
+int SearchThread::aspirationSearch(Position &RootPos, int Depth, int Score) {
   int δ = 15;
 
   int α = std::max(Score - δ, -INF_SCORE);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace pali {
+
+/// Static evaluations shared by every search thread.
+/// An entry is a single 64-bit word holding the lower 48 bits of the hash
+/// above the evaluation, so it's read and written without locks
+/// and can never be torn between two positions
+class EvalCache {
+  std::vector<std::atomic<uint64_t>> Data;
+
+  std::atomic<uint64_t> Hits = 0;
+  std::atomic<uint64_t> Misses = 0;
+
+public:
+  // Default at 2 MB
+  EvalCache() { resize(2); }
+
+  // clang-format off
+  [[nodiscard]] uint64_t index(uint64_t Hash) const {
+    return static_cast<uint64_t>(
+      (static_cast<__uint128_t>(Hash) *
+       static_cast<__uint128_t>(Data.size())) >> 64);
+  }
+  // clang-format on
+
+  /// Look up the evaluation of the position, return false if it isn't cached
+  [[nodiscard]] bool probe(uint64_t Hash, int &Eval) const {
+    const uint64_t Entry = Data[index(Hash)].load(std::memory_order_relaxed);
+
+    // The index comes from the upper bits of the hash, check the lower ones
+    if ((Entry ^ Hash << 16) >> 16 != 0)
+      return false;
+
+    Eval = static_cast<int16_t>(Entry & 0xffff);
+    return true;
+  }
+
+  void store(uint64_t Hash, int Eval) {
+    Data[index(Hash)].store(Hash << 16 | static_cast<uint16_t>(Eval),
+                            std::memory_order_relaxed);
+  }
+
+  void prefetch(uint64_t Hash) const { __builtin_prefetch(&Data[index(Hash)]); }
+
+  /// Add the counters of a search thread, which counts on its own
+  /// to keep every probe from writing to a shared cache line
+  void addStats(uint64_t ThreadHits, uint64_t ThreadMisses) {
+    Hits.fetch_add(ThreadHits, std::memory_order_relaxed);
+    Misses.fetch_add(ThreadMisses, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint64_t hits() const { return Hits; }
+
+  [[nodiscard]] uint64_t misses() const { return Misses; }
+
+  /// Forget every evaluation, needed when the network changes
+  void clear() {
+    for (auto &Entry : Data)
+      Entry.store(0, std::memory_order_relaxed);
+
+    Hits = 0;
+    Misses = 0;
+  }
+
+  /// Resize eval cache to size in MB
+  void resize(uint64_t Size) {
+    Data = std::vector<std::atomic<uint64_t>>(0x100000 * Size /
+                                              sizeof(uint64_t));
+    clear();
+  }
+};
+
+} // namespace pali
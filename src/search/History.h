@@ -4,37 +4,63 @@
 #include "core/Move.h"
 #include "core/Util.h"
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <cstdlib>
 
 namespace pali {
 
 constexpr int MH_CAP = 16384;
 
+/// Scores of moves by the moving piece and its destination,
+/// 16 bits are enough since gravity keeps them within MH_CAP
+using PieceToHist = std::array<std::array<int16_t, 64>, 6>;
+
+/// Continuation histories of the moves one and two plies before,
+/// null when there's no such move
+using ContHists = std::array<PieceToHist *, 2>;
+
 struct HTable {
   std::array<std::array<std::array<int, 64>, 64>, 2> MainHist{};
 
-  std::array<Move, 128> Killer;
+  /// Scores of quiet moves following a move, by the color, piece
+  /// and destination of that move
+  std::array<std::array<std::array<PieceToHist, 64>, 6>, 2> ContHist{};
 
   /// Update heuristics related to quiet moves
   template <Operation OP>
-  void updateQuiet(Color Stm, Move Mv, int Depth, int Ply) {
-    int BonusNum = Depth * Depth;
+  void updateQuiet(Color Stm, Move Mv, int Depth, ContHists Prev) {
+    // Gravity only keeps scores within the cap if bonuses are within it
+    int BonusNum = std::min(Depth * Depth, MH_CAP);
     int Bonus = OP == Operation::Add ? BonusNum : -BonusNum;
-    int &MHScore = MainHist[Stm][Mv.From][Mv.To];
-
-    // History Gravity:
-    // Give less bonus as the score approaches cap
-    Bonus -= abs(Bonus) * MHScore / MH_CAP;
 
     // Main History:
     // Each time a quiet move causes a cutoff, give it some score
     // scaling with depth
-    MHScore += Bonus;
+    addBonus(MainHist[Stm][Mv.From][Mv.To], Bonus);
+
+    // Continuation History:
+    // Same for the move as a reply to the previous moves
+    for (PieceToHist *Hist : Prev)
+      if (Hist)
+        addBonus((*Hist)[Mv.Pc][Mv.To], Bonus);
+  }
+
+  /// Score of a quiet move from every history
+  [[nodiscard]] int quietScore(Color Stm, Move Mv, ContHists Prev) const {
+    int Score = MainHist[Stm][Mv.From][Mv.To];
+
+    for (const PieceToHist *Hist : Prev)
+      if (Hist)
+        Score += (*Hist)[Mv.Pc][Mv.To];
 
-    // Killer Move:
-    // Try the quiet move that causes cutoff before other quiet moves
-    Killer[Ply] = Mv;
+    return Score;
+  }
+
+  /// Continuation history of the move the side to move is about to make
+  [[nodiscard]] PieceToHist *contHist(Color Stm, Move Mv) {
+    return &ContHist[Stm][Mv.Pc][Mv.To];
   }
 
   /// Decay history to use them in the next search
@@ -43,9 +69,26 @@ struct HTable {
       for (auto &ArrStm : ArrFrom)
         for (int &Val : ArrStm)
           Val /= 2;
+
+    for (auto &ArrCol : ContHist)
+      for (auto &ArrPc : ArrCol)
+        for (PieceToHist &Hist : ArrPc)
+          for (auto &ArrTo : Hist)
+            for (int16_t &Val : ArrTo)
+              Val /= 2;
+  }
+
+  void clear() {
+    MainHist = {};
+    ContHist = {};
   }
 
-  void clear() { MainHist = {}; }
+private:
+  template <typename T> void addBonus(T &Score, int Bonus) {
+    // History Gravity:
+    // Give less bonus as the score approaches cap
+    Score += Bonus - abs(Bonus) * Score / MH_CAP;
+  }
 };
 
 } // namespace pali
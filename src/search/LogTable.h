@@ -1,11 +0,0 @@
-#pragma once
-
-#include <cmath>
-
-namespace pali {
-
-void initLogTable();
-
-double ln(int i);
-
-} // namespace pali
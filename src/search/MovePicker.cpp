@@ -10,7 +10,6 @@
 #include "search/History.h"
 #include "search/SEE.h"
 
-#include <cassert>
 #include <cstdint>
 
 using namespace pali;
@@ -29,7 +28,7 @@ repick:
   case Best:
     goNext();
 
-    if (isPsuedoLegal(Pos, BestMove))
+    if (isPsuedoLegal(Pos, BestMove) && Pos.isLegal(BestMove))
       return BestMove;
 
   case GenŅoisy:
@@ -97,9 +96,9 @@ void MovePicker::scoreQuiet() {
   for (Move &Mv : QuietMl) {
     // History Heuristic:
     // Give moves that cause a lot of cutoff more score
-    Mv.Score += HTable.MainHist[Pos.stm()][Mv.From][Mv.To];
+    Mv.Score += HTable.quietScore(Pos.stm(), Mv, Prev);
 
-    if (Mv == HTable.Killer[Ply])
+    if (Mv == Killer)
       Mv.Score += KILLER_SCORE;
   }
 }
@@ -152,6 +151,10 @@ bool isPsuedoLegal(const Position &Pos, Move Mv) {
   if (!Us.getBit(From))
     return false;
 
+  // Captures need an enemy piece to take, other moves an empty square
+  if (!Mv.isEP() && Mv.isCapture() != static_cast<bool>(Them.getBit(To)))
+    return false;
+
   if (Flag == MFlag::Normal || Flag == MFlag::Capture) {
     if (Pc == Piece::Knight)
       return getKnightAttack(From).getBit(To);
@@ -173,12 +176,15 @@ bool isPsuedoLegal(const Position &Pos, Move Mv) {
     Bitboard PromoRank = Stm.isWhite() ? Bitboard::RANK_7 : Bitboard::RANK_2;
     Bitboard ThirdRank = Stm.isWhite() ? Bitboard::RANK_3 : Bitboard::RANK_6;
 
-    if (Mv.isPromo())
-      if (!PromoRank.getBit(From))
-        return false;
+    // Only promotions reach the last rank
+    if (Mv.isPromo() != static_cast<bool>(PromoRank.getBit(From)))
+      return false;
+
+    if (Mv.isCastle())
+      return false;
 
     if (Mv.isEP())
-      return Pos.epSq() != Square::None &&
+      return Pos.epSq() != Square::None && To == Pos.epSq() &&
              getPawnAttack(From, Stm).getBit(Pos.epSq());
 
     if (Mv.isCapture())
@@ -188,13 +194,15 @@ bool isPsuedoLegal(const Position &Pos, Move Mv) {
         (Stm.isWhite() ? From.toBB() >> 8 : From.toBB() << 8) & ~Occ;
 
     if (Mv.isDP())
-      return Stm.isWhite() ? (ValidPush & ThirdRank) >> 8 & ~Occ
-                           : (ValidPush & ThirdRank) << 8 & ~Occ;
+      ValidPush = Stm.isWhite() ? (ValidPush & ThirdRank) >> 8 & ~Occ
+                                : (ValidPush & ThirdRank) << 8 & ~Occ;
 
-    return ValidPush;
+    return ValidPush.getBit(To);
   }
 
-  assert(Pc == Piece::King);
+  // Only castling is left, anything else is a corrupted TT move
+  if (Pc != Piece::King)
+    return false;
 
   uint8_t Castle = 0;
   Square RookFrom = 11;
@@ -220,6 +228,10 @@ bool isPsuedoLegal(const Position &Pos, Move Mv) {
   }
 
   if (Mv.isCastle()) {
+    // The king of the side with the rights has to be the one castling
+    if (From != (Castle & 3 ? Square::E1 : Square::E8))
+      return false;
+
     Bitboard Path = getBetweenSq(From, RookFrom);
     return (Pos.rights() & Castle && !(Occ & Path) && !Pos.isInCheck() &&
             [&]() {
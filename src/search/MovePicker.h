@@ -17,13 +17,14 @@ struct MovePicker {
   MoveList NoisyMl;
   MoveList BadNoisyMl;
   const Position &Pos;
-  const int Ply;
   const Move BestMove;
+  const Move Killer;
+  const ContHists Prev;
   HTable &HTable;
 
-  MovePicker(const Position &Pos, int Ply, uint16_t PackedBM,
-             struct HTable &HTable)
-      : Pos(Pos), Ply(Ply),
+  MovePicker(const Position &Pos, uint16_t PackedBM, struct HTable &HTable,
+             Move Killer = Move(), ContHists Prev = {})
+      : Pos(Pos),
         BestMove(
             // Unpack best move
             [&Pos, PackedBM]() -> Move {
@@ -32,7 +33,7 @@ struct MovePicker {
 
               return {From, To, Flag, Pc};
             }()),
-        HTable(HTable) {}
+        Killer(Killer), Prev(Prev), HTable(HTable) {}
 
   /// Go to the next move picker stage
   void goNext() { Stage = static_cast<enum Stage>(Stage + 1); }
@@ -1,4 +1,3 @@
-#include "LogTable.h"
 #include "SEE.h"
 #include "SearchThread.h"
 
@@ -7,6 +6,7 @@
 #include "core/Position.h"
 #include "core/Util.h"
 #include "search/MovePicker.h"
+#include "search/Reduction.h"
 #include "search/TTable.h"
 
 #include <algorithm>
@@ -14,8 +14,7 @@
 
 using namespace pali;
 
-int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
-                          int β) {
+int SearchThread::negamax(Position &Pos, int Depth, int Ply, int α, int β) {
   // Increment node count and perform a checkup every 2048 nodes
   if ((++Nodes & 2047) == 0) {
     if (timeSpent() >= HardLim || Nodes >= NodesLim) {
@@ -31,11 +30,22 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
   const bool IsPVNode = β - α > 1;
   const bool IsInCheck = Pos.isInCheck();
 
+  SearchStack *Ss = &Stack[Ply + STACK_OFFSET];
+
   PVTable.Length[Ply] = Ply;
 
-  if (!IsRootNode && Pos.isDraw())
+  if (!IsRootNode && Pos.isDraw(History))
     return 0;
 
+  // Upcoming repetition:
+  // If a move repeats a position of the line the side to move
+  // can at least draw, so α can be raised to a draw right away
+  if (!IsRootNode && α < 0 && Pos.hasUpcomingRepetition(History, Ply)) {
+    α = 0;
+    if (α >= β)
+      return α;
+  }
+
   // Mate distance pruning
   α = std::max(α, -MATE_SCORE + Ply);
   β = std::min(β, MATE_SCORE - Ply);
@@ -51,30 +61,39 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     return qsearch(Pos, Ply + 1, α, β);
 
   // TT Probing
-  auto Tte = TTable.probeEntry(Pos.hash());
-  bool TTHit = Tte != nullptr;
+  TTEntry Tte;
+  bool TTHit = TTable.probeEntry(Pos.hash(), Tte, TTStats);
 
   // TT cutoff
-  if (TTHit && !IsPVNode && Depth <= Tte->Depth) {
-    int TTScore = Tte->Score;
+  if (TTHit && !IsPVNode && Depth <= Tte.Depth) {
+    int TTScore = Tte.Score;
 
-    switch (Tte->bound()) {
+    switch (Tte.bound()) {
     case Bound::Upper:
       if (TTScore <= α)
-        return TTScore;
+        return ttCutoff(TTScore);
 
     case Bound::Lower:
       if (TTScore >= β)
-        return TTScore;
+        return ttCutoff(TTScore);
 
     case Bound::Exact:
-      return TTScore;
+      return ttCutoff(TTScore);
     }
   }
 
-  int Eval = TTHit ? Tte->Eval : Pos.evaluate();
+  int Eval = TTHit ? Tte.Eval : evaluate(Pos);
   int BestScore = -INF_SCORE;
-  uint16_t BestMove = TTHit ? Tte->BestMove : 0;
+  uint16_t BestMove = TTHit ? Tte.BestMove : 0;
+
+  Ss->StaticEval = IsInCheck ? NO_SCORE : Eval;
+
+  // Improving:
+  // The static evaluation got better since our last move,
+  // so fail highs are more likely and pruning can be more aggressive
+  const bool Improving = Ss->StaticEval != NO_SCORE &&
+                         (Ss - 2)->StaticEval != NO_SCORE &&
+                         Ss->StaticEval > (Ss - 2)->StaticEval;
 
   if (!IsPVNode && !IsInCheck) {
     bool isKPEndgame =
@@ -84,7 +103,7 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     // Static NMP/Reverse Futility Pruning:
     // If eval is a certain amount above β,
     // prune out the node immediately
-    int RfpMargin = Depth * 80;
+    int RfpMargin = (Depth - Improving) * 80;
     if (Eval >= β + RfpMargin)
       return Eval;
 
@@ -97,11 +116,13 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     if (Eval >= β && Depth >= NmpDepth && !isKPEndgame) {
       int R = 3 + Depth / 3 + std::min((Eval - β) / 200, 3);
 
-      const_cast<Position &>(Pos).changeSide();
+      Ss->Mv = NULL_MOVE;
+      Ss->ContHist = nullptr;
+      Pos.makeNullMove(States[Ply]);
 
       int NmpScore = -negamax(Pos, Depth - R, Ply + 1, -β, -β + 1);
 
-      const_cast<Position &>(Pos).changeSide();
+      Pos.unmakeNullMove(States[Ply]);
 
       if (NmpScore >= β)
         // Prevent returning false mate
@@ -117,7 +138,9 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
 
   Bound Bound = Bound::Upper;
   int MovesMade = 0;
-  MovePicker Mp(Pos, Ply, BestMove, HTable);
+  const ContHists Prev = {(Ss - 1)->ContHist, (Ss - 2)->ContHist};
+
+  MovePicker Mp(Pos, BestMove, HTable, Ss->Killer, Prev);
   while (true) {
     Move Mv = Mp.nextMove<false>();
 
@@ -129,11 +152,17 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     if (IsRootNode && isSearched(Mv))
       continue;
 
-    Position PosCopy = Pos;
-
-    // Skip illegal moves
-    if (!PosCopy.makeMove(Mv))
+    // Late Move Pruning:
+    // Quiet moves ordered this late are unlikely to beat the moves
+    // before them, skip them near the leaves unless every move so far
+    // gets mated
+    // clang-format off
+    if (!IsPVNode && !IsInCheck && Depth <= 8 &&
+        Mp.Stage == MovePicker::Quiet &&
+        BestScore > -MATE_SCORE + MAX_PLY &&
+        MovesMade >= (3 + Depth * Depth) / (2 - Improving))
       continue;
+    // clang-format on
 
     // SEE pruning:
     // Skip the move if its SEE score is below a certain threshold
@@ -141,8 +170,14 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     if (!see(Pos, Mv, Threshold))
       continue;
 
-    // Prefetch TT if the move is legal
-    TTable.prefetch(PosCopy.hash());
+    Ss->Mv = Mv;
+    Ss->ContHist = HTable.contHist(Pos.stm(), Mv);
+
+    makeMove(Pos, Mv, Ply);
+
+    // Prefetch TT and eval cache
+    TTable.prefetch(Pos.hash());
+    EvalCache.prefetch(Pos.hash());
 
     ++MovesMade;
 
@@ -154,31 +189,43 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     if (Depth >= 2 &&
         Mp.Stage >= MovePicker::Quiet &&
         Mv.Score < 2'000'000'000) {
-      Reduction = static_cast<int>(0.3 * ln(Depth) * ln(MovesMade) + 0.8);
-
-      Reduction -= IsPVNode;
+      const bool IsQuiet = Mp.Stage == MovePicker::Quiet;
+      int R = lateMoveReduction(IsQuiet, IsPVNode, Depth, MovesMade);
+
+      R += !Improving * REDUCTION_UNIT;
+
+      // Quiet moves that caused cutoffs before are reduced less,
+      // by up to a ply with the main and both continuation histories
+      // at the cap. The move is already made, so the other side made it.
+      // Its ordering score can't be used, killers carry a huge bonus
+      if (IsQuiet) {
+        const int HistScore =
+            HTable.quietScore(Pos.stm().inverse(), Mv, Prev);
+        R -= HistScore * REDUCTION_UNIT / (3 * MH_CAP);
+      }
+
+      Reduction = reductionPlies(R);
     }
     // clang-format on
 
-    // Don't accidentally extend
-    Reduction = std::max(Reduction, 0);
-
     // Search the first move with full window
     int Score;
     if (MovesMade == 1)
-      Score = -negamax(PosCopy, Depth - 1 - Reduction, Ply + 1, -β, -α);
+      Score = -negamax(Pos, Depth - 1 - Reduction, Ply + 1, -β, -α);
 
     // Perform zero window search on the rest
     else {
       int ZwsScore =
-          -negamax(PosCopy, Depth - 1 - Reduction, Ply + 1, -α - 1, -α);
+          -negamax(Pos, Depth - 1 - Reduction, Ply + 1, -α - 1, -α);
 
       // If the move doesn't fail low, continue searching as PV node
       Score = ZwsScore > α && IsPVNode
-                  ? -negamax(PosCopy, Depth - 1, Ply + 1, -β, -α)
+                  ? -negamax(Pos, Depth - 1, Ply + 1, -β, -α)
                   : ZwsScore;
     };
 
+    unmakeMove(Pos, Mv, Ply);
+
     if (Score <= BestScore)
       continue;
 
@@ -189,8 +236,13 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
     if (Score >= β) {
       Bound = Bound::Lower;
 
-      if (!Mv.isCapture())
-        HTable.updateQuiet<Operation::Add>(Pos.stm(), Mv, Depth, Ply);
+      if (!Mv.isCapture()) {
+        HTable.updateQuiet<Operation::Add>(Pos.stm(), Mv, Depth, Prev);
+
+        // Killer Move:
+        // Try the quiet move that causes cutoff before other quiet moves
+        Ss->Killer = Mv;
+      }
 
       break;
     }
@@ -206,7 +258,8 @@ int SearchThread::negamax(const Position &Pos, int Depth, int Ply, int α,
   if (MovesMade == 0)
     return IsInCheck ? -MATE_SCORE + Ply : 0;
 
-  TTable.storeEntry(Pos.hash(), BestMove, BestScore, Eval, Bound, Depth);
+  TTable.storeEntry(Pos.hash(), BestMove, BestScore, Eval, Bound, Depth,
+                    TTStats);
 
   return BestScore;
 }
@@ -10,7 +10,7 @@
 
 using namespace pali;
 
-int SearchThread::qsearch(const Position &Pos, int Ply, int α, int β) {
+int SearchThread::qsearch(Position &Pos, int Ply, int α, int β) {
   // Increment node count and perform a checkup every 2048 nodes
   if ((++Nodes & 2047) == 0) {
     if (timeSpent() >= HardLim || Nodes >= NodesLim) {
@@ -19,12 +19,12 @@ int SearchThread::qsearch(const Position &Pos, int Ply, int α, int β) {
     }
   }
 
-  if (Pos.isDraw())
+  if (Pos.isDraw(History))
     return 0;
 
   SelDepth = std::max(SelDepth, Ply);
 
-  int Eval = Pos.evaluate();
+  int Eval = evaluate(Pos);
   int BestScore = -INF_SCORE;
   uint16_t BestMove = 0;
 
@@ -35,20 +35,17 @@ int SearchThread::qsearch(const Position &Pos, int Ply, int α, int β) {
   α = std::max(α, BestScore);
 
   Bound Bound = Bound::Upper;
-  MovePicker Mp(Pos, Ply, BestMove, HTable);
+  MovePicker Mp(Pos, BestMove, HTable);
   while (true) {
     Move Mv = Mp.nextMove<true>();
-    Position PosCopy = Pos;
 
     // Move picker finished
     if (Mv.isNullMove())
       break;
 
-    // Skip illegal moves
-    if (!PosCopy.makeMove(Mv))
-      continue;
-
-    int Score = -qsearch(PosCopy, Ply + 1, -β, -α);
+    makeMove(Pos, Mv, Ply);
+    int Score = -qsearch(Pos, Ply + 1, -β, -α);
+    unmakeMove(Pos, Mv, Ply);
 
     if (Score <= BestScore)
       continue;
@@ -66,7 +63,7 @@ int SearchThread::qsearch(const Position &Pos, int Ply, int α, int β) {
     α = std::max(α, Score);
   }
 
-  TTable.storeEntry(Pos.hash(), BestMove, BestScore, Eval, Bound, 0);
+  TTable.storeEntry(Pos.hash(), BestMove, BestScore, Eval, Bound, 0, TTStats);
 
   return BestScore;
 }
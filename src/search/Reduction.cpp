@@ -0,0 +1,56 @@
+#include "search/Reduction.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+using namespace pali;
+
+// Deeper nodes and later moves use the last row and column
+constexpr int LMR_MAX_DEPTH = 64;
+constexpr int LMR_MAX_MOVES = 64;
+
+/// Reduction of Base + Factor * ln(depth) * ln(moves made) plies
+struct LmrParams {
+  double Base;
+  double Factor;
+};
+
+// Placeholders: every table starts from the old single formula,
+// quiet and noisy moves are the same until they are tuned apart
+// clang-format off
+constexpr LmrParams LMR_PARAMS[2][2] = {
+  // Noisy     PV
+  {{0.8, 0.3}, {-0.2, 0.3}},
+  // Quiet     PV
+  {{0.8, 0.3}, {-0.2, 0.3}},
+};
+// clang-format on
+
+/// Reductions by [quiet][PV][depth][moves made]
+static std::array<std::array<std::array<std::array<int16_t, LMR_MAX_MOVES>,
+                                         LMR_MAX_DEPTH>,
+                              2>,
+                  2>
+    LmrTable;
+
+void pali::initReductions() {
+  for (int IsQuiet = 0; IsQuiet < 2; ++IsQuiet) {
+    for (int IsPV = 0; IsPV < 2; ++IsPV) {
+      const auto [Base, Factor] = LMR_PARAMS[IsQuiet][IsPV];
+
+      for (int Depth = 1; Depth < LMR_MAX_DEPTH; ++Depth)
+        for (int Moves = 1; Moves < LMR_MAX_MOVES; ++Moves)
+          LmrTable[IsQuiet][IsPV][Depth][Moves] = static_cast<int16_t>(
+              REDUCTION_UNIT *
+              (Base + Factor * std::log(Depth) * std::log(Moves)));
+    }
+  }
+}
+
+int pali::lateMoveReduction(bool IsQuiet, bool IsPVNode, int Depth,
+                            int MovesMade) {
+  return LmrTable[IsQuiet][IsPVNode][std::min(Depth, LMR_MAX_DEPTH - 1)]
+                 [std::min(MovesMade, LMR_MAX_MOVES - 1)];
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace pali {
+
+/// Reductions are counted in 1/1024 of a ply,
+/// so adjustments smaller than a ply add up before they're rounded down
+constexpr int REDUCTION_UNIT = 1024;
+
+/// Build the late move reduction tables
+void initReductions();
+
+/// Base late move reduction of the MovesMade-th move of a node,
+/// in 1/1024 of a ply
+[[nodiscard]] int lateMoveReduction(bool IsQuiet, bool IsPVNode, int Depth,
+                                    int MovesMade);
+
+/// Whole plies of a reduction in 1/1024 of a ply, never an extension
+[[nodiscard]] constexpr int reductionPlies(int Reduction) {
+  return Reduction > 0 ? Reduction / REDUCTION_UNIT : 0;
+}
+
+} // namespace pali
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "core/KeyHistory.h"
 #include "core/Move.h"
 #include "core/Position.h"
 #include "core/Util.h"
+#include "nnue/AccumulatorStack.h"
+#include "search/EvalCache.h"
 #include "search/History.h"
 #include "search/TTable.h"
 
@@ -36,35 +39,93 @@ struct PVTable {
   }
 };
 
-struct SearchThread {
+/// State of a node of the current line, kept for the nodes below it
+struct SearchStack {
+  /// Static evaluation, none when in check
+  int StaticEval = NO_SCORE;
+
+  /// Move being searched, null move for null move pruning
+  Move Mv;
+
+  /// Quiet move that caused the last cutoff at this ply
+  Move Killer;
+
+  /// Continuation history of the move being searched
+  PieceToHist *ContHist = nullptr;
+};
+
+/// Limits of a search from the go command
+struct SearchLimits {
+  uint64_t Time = UINT64_MAX;
+  uint64_t Inc = 0;
+  uint64_t MoveTime = UINT64_MAX;
+  int MovesToGo = 20;
+  int Depth = 255;
+  uint64_t Nodes = UINT64_MAX;
+  int MultiPV = 1;
+};
+
+/// Search state of a thread of the pool, kept from one search to the next
+struct alignas(64) SearchThread {
   std::atomic<bool> &Stopped;
 
-  const int DepthLim;
-  const uint64_t NodesLim;
+  int DepthLim = 0;
+  uint64_t NodesLim = 0;
 
-  const int MultiPV;
+  int MultiPV = 1;
   std::vector<Move> SearchedPV;
 
-  const uint64_t StartTime;
-  const uint64_t HardLim;
-  const uint64_t SoftLim;
+  uint64_t StartTime = 0;
+  uint64_t HardLim = 0;
+  uint64_t SoftLim = 0;
 
   int SelDepth = 0;
   uint64_t Nodes = 0;
 
+  uint64_t EvalHits = 0;
+  uint64_t EvalMisses = 0;
+
+  TTStats TTStats;
+
   PVTable PVTable;
+  AccumulatorStack Accumulators;
+
+  /// Undo information of the move made at each ply,
+  /// the search makes and takes back moves on a single position
+  std::array<StateInfo, AccumulatorStack::CAPACITY> States;
+
+  /// Hashes of the game and of the current line, set for every search
+  KeyHistory History;
+
+  /// Entries before the root stay empty so a node can always look back
+  static constexpr int STACK_OFFSET = 2;
+  std::array<SearchStack, AccumulatorStack::CAPACITY + STACK_OFFSET> Stack;
+
+  HTable HTable;
   TTable &TTable;
-  HTable &HTable;
-
-  SearchThread(std::atomic<bool> &Stopped, uint64_t Time, uint64_t Inc,
-               uint64_t MoveTime, int MovesToGo, int DepthLim,
-               uint64_t NodesLim, int MultiPV, class TTable &TTable,
-               struct HTable &HTable)
-      : Stopped(Stopped), DepthLim(DepthLim), NodesLim(NodesLim),
-        MultiPV(MultiPV), StartTime(getTimeMs()),
-        HardLim(std::min(MoveTime, Time / MovesToGo + 3 * Inc / 4)),
-        SoftLim(HardLim == MoveTime ? MoveTime : 7 * HardLim / 10),
-        TTable(TTable), HTable(HTable) {}
+  EvalCache &EvalCache;
+
+  SearchThread(std::atomic<bool> &Stopped, class TTable &TTable,
+               class EvalCache &EvalCache)
+      : Stopped(Stopped), TTable(TTable), EvalCache(EvalCache) {}
+
+  /// Set the limits of the next search and reset its counters
+  void start(const SearchLimits &Limits) {
+    DepthLim = Limits.Depth;
+    NodesLim = Limits.Nodes;
+    MultiPV = Limits.MultiPV;
+
+    StartTime = getTimeMs();
+    HardLim = std::min(Limits.MoveTime, Limits.Time / Limits.MovesToGo +
+                                            3 * Limits.Inc / 4);
+    SoftLim = HardLim == Limits.MoveTime ? Limits.MoveTime : 7 * HardLim / 10;
+
+    SelDepth = 0;
+    Nodes = 0;
+    EvalHits = 0;
+    EvalMisses = 0;
+    TTStats = {};
+  }
 
   template <bool MAIN> void go(Position &RootPos);
 
@@ -75,15 +136,50 @@ struct SearchThread {
 private:
   /// Aspiration window:
   /// Search with decreased α-β window
-  [[nodiscard]] int aspirationSearch(const Position &RootPos, int Depth,
-                                     int Score);
+  [[nodiscard]] int aspirationSearch(Position &RootPos, int Depth, int Score);
 
   /// Main search function
-  [[nodiscard]] int negamax(const Position &Pos, int Depth, int Ply, int α,
-                            int β);
+  [[nodiscard]] int negamax(Position &Pos, int Depth, int Ply, int α, int β);
 
   /// Quiessence search
-  [[nodiscard]] int qsearch(const Position &Pos, int Ply, int α, int β);
+  [[nodiscard]] int qsearch(Position &Pos, int Ply, int α, int β);
+
+  /// Make the move at the given ply
+  void makeMove(Position &Pos, Move Mv, int Ply) {
+    History.push(Pos.hash());
+    Pos.makeMove(Mv, States[Ply]);
+    Accumulators.push(States[Ply].Dirty);
+  }
+
+  void unmakeMove(Position &Pos, Move Mv, int Ply) {
+    Pos.unmakeMove(Mv, States[Ply]);
+    History.pop();
+    Accumulators.pop();
+  }
+
+  /// Static evaluation, taken from the eval cache when possible
+  /// so the accumulators don't even have to be brought up to date
+  [[nodiscard]] int evaluate(const Position &Pos) {
+    int Eval;
+    if (EvalCache.probe(Pos.hash(), Eval)) {
+      ++EvalHits;
+      return Eval;
+    }
+
+    ++EvalMisses;
+    Eval = Accumulators.evaluate(Pos);
+    EvalCache.store(Pos.hash(), Eval);
+
+    return Eval;
+  }
+
+  /// Count a cutoff from the transposition table, returns its score
+  [[nodiscard]] int ttCutoff(int Score) {
+    if constexpr (TT_STATS_ENABLED)
+      ++TTStats.Cutoffs;
+
+    return Score;
+  }
 
   /// Check if move is already searched
   [[nodiscard]] bool isSearched(Move Mv) {
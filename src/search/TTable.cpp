@@ -0,0 +1,348 @@
+#include "search/TTable.h"
+
+#include "core/Memory.h"
+#include "core/Zobrist.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace pali;
+
+/// Bumped whenever TTEntry or TTCluster change
+constexpr uint32_t TT_FORMAT = 1;
+
+constexpr std::array<char, 8> TT_MAGIC = {'P', 'A', 'L', 'I',
+                                          'H', 'A', 'S', 'H'};
+
+constexpr std::array<char, 8> TT_SHARED_MAGIC = {'P', 'A', 'L', 'I',
+                                                 'S', 'H', 'T', 'T'};
+
+/// Lowest hash indexing the cluster in a table of the given size
+__uint128_t firstHash(uint64_t Cluster, uint64_t NumClusters) {
+  return ((static_cast<__uint128_t>(Cluster) << 64) + NumClusters - 1) /
+         NumClusters;
+}
+
+/// Same as TTable::index(), for hashes up to 2^64
+uint64_t clusterOf(__uint128_t Hash, uint64_t NumClusters) {
+  return (Hash * NumClusters) >> 64;
+}
+
+void TTable::resize(uint64_t Size, int Threads) {
+  if (Shared != nullptr) {
+    std::cout << "info string Hash is fixed by the shared hash" << std::endl;
+    return;
+  }
+
+  const uint64_t NewClusters = 0x100000 * Size / sizeof(TTCluster);
+  TTCluster *NewData = allocate(NewClusters);
+
+  if (NewData == nullptr) {
+    std::cout << "info string can't allocate " << Size << " MB of hash"
+              << std::endl;
+
+    // Keep searching with the current table if there is one
+    if (Data != nullptr)
+      return;
+
+    std::exit(1);
+  }
+
+  replace(NewData, NewClusters, nullptr, Threads);
+}
+
+bool TTable::share(const std::string &Name, int Threads, std::string &Error) {
+  if (Name.empty()) {
+    if (Shared == nullptr)
+      return true;
+
+    TTCluster *NewData = allocate(NumClusters);
+
+    if (NewData == nullptr) {
+      Error = "can't allocate private hash";
+      return false;
+    }
+
+    // Keep what was found so far
+    replace(NewData, NumClusters, nullptr, Threads);
+    return true;
+  }
+
+  if (Name.find('/') != std::string::npos) {
+    Error = "shared hash names can't contain /";
+    return false;
+  }
+
+  std::size_t Size = sizeof(TTSharedHeader) + NumClusters * sizeof(TTCluster);
+  bool Created = false;
+  void *Segment = openShared("/pali-hash-" + Name, Size, Created);
+
+  if (Segment == nullptr) {
+    Error = "can't open shared memory";
+    return false;
+  }
+
+  auto *Header = static_cast<TTSharedHeader *>(Segment);
+  auto *Clusters = reinterpret_cast<TTCluster *>(Header + 1);
+
+  if (Created) {
+    Header->Magic = TT_SHARED_MAGIC;
+    Header->Version = TT_FORMAT;
+    Header->ClusterSize = sizeof(TTCluster);
+    Header->NumClusters = NumClusters;
+    Header->ZobristSeed = ZOBRIST_SEED;
+    Header->Age.store(age(), std::memory_order_relaxed);
+
+    // Start with what was found so far, others only use it once it's there
+    replace(Clusters, NumClusters, Header, Threads);
+    Header->Ready.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // Give the creator some time to fill the table
+  for (int Tries = 0;
+       !Header->Ready.load(std::memory_order_acquire) && Tries < 10000; ++Tries)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  if (!Header->Ready.load(std::memory_order_acquire) ||
+      Header->Magic != TT_SHARED_MAGIC || Header->Version != TT_FORMAT ||
+      Header->ClusterSize != sizeof(TTCluster) ||
+      Header->ZobristSeed != ZOBRIST_SEED ||
+      Size != sizeof(TTSharedHeader) +
+                  Header->NumClusters * sizeof(TTCluster)) {
+    closeShared(Segment, Size);
+    Error = "shared hash " + Name + " was made by an incompatible build";
+    return false;
+  }
+
+  // Every process has to ask for the same table
+  if (Header->NumClusters != NumClusters) {
+    const uint64_t SharedMB = Header->NumClusters * sizeof(TTCluster) >> 20;
+    const uint64_t HashMB = NumClusters * sizeof(TTCluster) >> 20;
+    closeShared(Segment, Size);
+
+    Error = "shared hash " + Name + " has " + std::to_string(SharedMB) +
+            " MB but Hash is " + std::to_string(HashMB) + " MB";
+    return false;
+  }
+
+  // Other processes are searching with it, don't touch the entries
+  release(Data, NumClusters, Shared);
+
+  Data = Clusters;
+  Shared = Header;
+  Age = &Header->Age;
+
+  return true;
+}
+
+void TTable::setInterleaved(bool Enabled) {
+  Interleave = Enabled ? numaNodes() : std::vector<NumaNode>();
+
+  if (Shared != nullptr)
+    return;
+
+  // Move the pages already placed. Turning it off leaves them
+  // interleaved until the table is allocated again
+  if (!Interleave.empty())
+    interleaveMemory(Data, NumClusters * sizeof(TTCluster), Interleave);
+}
+
+TTCluster *TTable::allocate(uint64_t Clusters) const {
+  void *NewData = allocHuge(Clusters * sizeof(TTCluster));
+
+  // Before clearing touches the pages
+  if (NewData != nullptr && !Interleave.empty())
+    interleaveMemory(NewData, Clusters * sizeof(TTCluster), Interleave);
+
+  return static_cast<TTCluster *>(NewData);
+}
+
+void TTable::replace(TTCluster *NewData, uint64_t NewClusters,
+                     TTSharedHeader *NewShared, int Threads) {
+  TTCluster *OldData = std::exchange(Data, NewData);
+  const uint64_t OldClusters = std::exchange(NumClusters, NewClusters);
+  TTSharedHeader *OldShared = std::exchange(Shared, NewShared);
+
+  const uint8_t OldAge = age();
+  Age = Shared != nullptr ? &Shared->Age : &PrivateAge;
+  Age->store(OldAge, std::memory_order_relaxed);
+
+  clear(Threads);
+
+  if (OldData == nullptr)
+    return;
+
+  forEachSlice(Threads, [&](uint64_t Start, uint64_t End) {
+    migrate(OldData, OldClusters, Start, End);
+  });
+
+  release(OldData, OldClusters, OldShared);
+}
+
+void TTable::release(TTCluster *Data, uint64_t NumClusters,
+                     TTSharedHeader *Shared) {
+  if (Shared != nullptr)
+    closeShared(Shared,
+                sizeof(TTSharedHeader) + NumClusters * sizeof(TTCluster));
+  else
+    freeHuge(Data, NumClusters * sizeof(TTCluster));
+}
+
+void TTable::migrate(const TTCluster *Old, uint64_t OldClusters,
+                     uint64_t Start, uint64_t End) {
+  // Entries only keep the lower bits of their hash, all that's known of
+  // the rest is the range of hashes indexing their old cluster.
+  // That range might index several new clusters, the entries are copied
+  // to each of them, or to MAX_COPIES spread over them, and aged by a
+  // search so the copies that aren't reachable get replaced first
+  for (uint64_t i = clusterOf(firstHash(Start, NumClusters), OldClusters);
+       i < OldClusters; ++i) {
+    const uint64_t First = clusterOf(firstHash(i, OldClusters), NumClusters);
+    const uint64_t Last =
+        clusterOf(firstHash(i + 1, OldClusters) - 1, NumClusters);
+
+    if (First >= End)
+      break;
+
+    const uint64_t Targets = Last - First + 1;
+    const uint64_t Copies = std::min(Targets, MAX_COPIES);
+
+    for (int j = 0; j < TTCluster::SIZE; ++j) {
+      uint64_t EntryData = Old[i].data(j);
+      if (EntryData == 0)
+        continue;
+
+      const uint16_t Key = Old[i].key(j, EntryData);
+
+      if (Copies > 1) {
+        TTEntry Entry(EntryData);
+        Entry.Other = static_cast<int>(Entry.bound()) |
+                      ((Entry.age() + 63) & 63) << 2;
+        EntryData = Entry.pack();
+      }
+
+      // Only this thread's clusters
+      for (uint64_t c = 0; c < Copies; ++c)
+        if (const uint64_t k = First + c * Targets / Copies;
+            k >= Start && k < End)
+          place(Data[k], Key, EntryData);
+    }
+  }
+}
+
+void TTable::place(TTCluster &Cluster, uint16_t Key, uint64_t EntryData) {
+  const auto worth = [this](uint64_t Data) {
+    const TTEntry Entry(Data);
+    return Entry.Depth - AGE_WEIGHT * relativeAge(Entry);
+  };
+
+  int Victim = 0;
+
+  for (int i = 0; i < TTCluster::SIZE; ++i) {
+    if (Cluster.data(i) == 0) {
+      Cluster.store(i, Key, EntryData);
+      return;
+    }
+
+    if (worth(Cluster.data(i)) < worth(Cluster.data(Victim)))
+      Victim = i;
+  }
+
+  if (worth(EntryData) > worth(Cluster.data(Victim)))
+    Cluster.store(Victim, Key, EntryData);
+}
+
+std::array<uint64_t, 64> TTable::ageHistogram() const {
+  std::array<uint64_t, 64> Histogram{};
+
+  for (uint64_t i = 0; i < std::min<uint64_t>(NumClusters, 1 << 16); ++i)
+    for (int j = 0; j < TTCluster::SIZE; ++j)
+      if (const uint64_t EntryData = Data[i].data(j); EntryData != 0)
+        ++Histogram[relativeAge(TTEntry(EntryData))];
+
+  return Histogram;
+}
+
+bool TTable::save(const std::string &Path, std::string &Error) const {
+  std::ofstream File(Path, std::ios::binary);
+  if (!File) {
+    Error = "can't open " + Path;
+    return false;
+  }
+
+  TTFileHeader Header{};
+  Header.Magic = TT_MAGIC;
+  Header.Version = TT_FORMAT;
+  Header.ClusterSize = sizeof(TTCluster);
+  Header.NumClusters = NumClusters;
+  Header.ZobristSeed = ZOBRIST_SEED;
+  Header.Age = age();
+
+  File.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  File.write(reinterpret_cast<const char *>(Data),
+             NumClusters * sizeof(TTCluster));
+
+  if (!File) {
+    Error = "can't write " + Path;
+    return false;
+  }
+
+  return true;
+}
+
+bool TTable::load(const std::string &Path, std::string &Error) {
+  std::ifstream File(Path, std::ios::binary);
+  if (!File) {
+    Error = "can't open " + Path;
+    return false;
+  }
+
+  TTFileHeader Header{};
+  File.read(reinterpret_cast<char *>(&Header), sizeof(Header));
+
+  if (!File || Header.Magic != TT_MAGIC) {
+    Error = Path + " isn't a Pali hash file";
+    return false;
+  }
+
+  if (Header.Version != TT_FORMAT ||
+      Header.ClusterSize != sizeof(TTCluster)) {
+    Error = "hash entry format " + std::to_string(Header.Version) +
+            " isn't supported, expected " + std::to_string(TT_FORMAT);
+    return false;
+  }
+
+  if (Header.ZobristSeed != ZOBRIST_SEED) {
+    Error = "hash was saved with different Zobrist keys";
+    return false;
+  }
+
+  if (Header.NumClusters != NumClusters) {
+    Error = "hash was saved with Hash " +
+            std::to_string(Header.NumClusters * sizeof(TTCluster) / 0x100000) +
+            ", set it first";
+    return false;
+  }
+
+  File.read(reinterpret_cast<char *>(Data), NumClusters * sizeof(TTCluster));
+
+  // Don't search with half a table
+  if (!File) {
+    clear(1);
+    Error = Path + " is truncated";
+    return false;
+  }
+
+  Age->store(Header.Age, std::memory_order_relaxed);
+
+  return true;
+}
@@ -1,8 +1,15 @@
 #pragma once
 
-#include <algorithm>
+#include "core/Memory.h"
+#include "core/Numa.h"
+
+#include <array>
 #include <atomic>
 #include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace pali {
@@ -11,7 +18,6 @@ enum class Bound { Upper, Lower, Exact };
 
 // Transposition table entry
 struct TTEntry {
-  uint64_t Hash = 0;
   uint16_t BestMove = 0;
   int16_t Score = 32001;
   int16_t Eval = 32001;
@@ -20,87 +26,378 @@ struct TTEntry {
 
   TTEntry() {};
 
-  TTEntry(uint64_t Hash, uint16_t BestMove, int16_t Score, int16_t Eval,
-          Bound Bound, uint8_t Age, uint8_t Depth)
-      : Hash(Hash), BestMove(BestMove), Score(Score),
+  TTEntry(uint16_t BestMove, int16_t Score, int16_t Eval, Bound Bound,
+          uint8_t Age, uint8_t Depth)
+      : BestMove(BestMove), Score(Score), Eval(Eval),
         Other(static_cast<int>(Bound) | (Age << 2)), Depth(Depth) {}
 
+  /// Entry packed into a single 64-bit word
+  explicit TTEntry(uint64_t Data)
+      : BestMove(Data), Score(Data >> 16), Eval(Data >> 32),
+        Other(Data >> 48), Depth(Data >> 56) {}
+
   Bound bound() const { return static_cast<Bound>(Other & 3); }
 
   uint8_t age() const { return (Other & 252) >> 2; }
+
+  [[nodiscard]] uint64_t pack() const {
+    return static_cast<uint64_t>(BestMove) |
+           static_cast<uint64_t>(static_cast<uint16_t>(Score)) << 16 |
+           static_cast<uint64_t>(static_cast<uint16_t>(Eval)) << 32 |
+           static_cast<uint64_t>(Other) << 48 |
+           static_cast<uint64_t>(Depth) << 56;
+  }
+};
+
+/// Three entries sharing half a cache line, a probe only ever touches
+/// one cluster. An entry is its packed data in a 64-bit atomic and a
+/// 16-bit key: the lower bits of the hash, the upper ones pick the cluster.
+/// Every search thread shares the table without locks, so the key is
+/// stored XOR the data folded to 16 bits and a reader seeing the words of
+/// two different stores almost always gets a key that doesn't match
+struct alignas(32) TTCluster {
+  static constexpr int SIZE = 3;
+
+  std::array<std::atomic<uint64_t>, SIZE> Data;
+  std::array<std::atomic<uint16_t>, SIZE> Keys;
+
+  [[nodiscard]] static uint16_t fold(uint64_t Data) {
+    return Data ^ Data >> 16 ^ Data >> 32 ^ Data >> 48;
+  }
+
+  [[nodiscard]] uint64_t data(int i) const {
+    return Data[i].load(std::memory_order_relaxed);
+  }
+
+  /// Lower 16 bits of the hash of the entry read as EntryData
+  [[nodiscard]] uint16_t key(int i, uint64_t EntryData) const {
+    return Keys[i].load(std::memory_order_relaxed) ^ fold(EntryData);
+  }
+
+  void store(int i, uint64_t Hash, uint64_t NewData) {
+    Data[i].store(NewData, std::memory_order_relaxed);
+    Keys[i].store(static_cast<uint16_t>(Hash) ^ fold(NewData),
+                  std::memory_order_relaxed);
+  }
+};
+
+static_assert(sizeof(TTCluster) == 32);
+
+#ifdef TT_STATS
+constexpr bool TT_STATS_ENABLED = true;
+#else
+constexpr bool TT_STATS_ENABLED = false;
+#endif
+
+/// Transposition table counters of a search thread,
+/// only counted in builds configured with -DTT_STATS=ON
+struct TTStats {
+  uint64_t Probes = 0;
+  uint64_t Hits = 0;
+  uint64_t Cutoffs = 0;    // Hits ending the search of the node
+  uint64_t Collisions = 0; // Misses on a cluster full of other positions
+
+  uint64_t Fills = 0;   // Stores into an empty entry
+  uint64_t Updates = 0; // Stores over the same position
+  uint64_t Kept = 0;    // Stores skipped to keep a much deeper entry
+  uint64_t ByDepth = 0; // Stores over a shallower entry of this search
+  uint64_t ByAge = 0;   // Stores over an entry of an older search
+
+  TTStats &operator+=(const TTStats &Other) {
+    Probes += Other.Probes;
+    Hits += Other.Hits;
+    Cutoffs += Other.Cutoffs;
+    Collisions += Other.Collisions;
+    Fills += Other.Fills;
+    Updates += Other.Updates;
+    Kept += Other.Kept;
+    ByDepth += Other.ByDepth;
+    ByAge += Other.ByAge;
+
+    return *this;
+  }
+};
+
+/// Header of a saved transposition table, followed by its clusters
+struct alignas(64) TTFileHeader {
+  std::array<char, 8> Magic; // "PALIHASH"
+  uint32_t Version;          // Entry format
+  uint32_t ClusterSize;
+  uint64_t NumClusters;
+  uint64_t ZobristSeed;
+  uint8_t Age;
 };
 
+static_assert(sizeof(TTFileHeader) == 64);
+
+/// Header of a table shared between processes, followed by its clusters
+struct alignas(64) TTSharedHeader {
+  std::array<char, 8> Magic; // "PALISHTT"
+  uint32_t Version;          // Entry format
+  uint32_t ClusterSize;
+  uint64_t NumClusters;
+  uint64_t ZobristSeed;
+  std::atomic<uint8_t> Age;
+  std::atomic<bool> Ready; // Set by the creator once the table is written
+};
+
+static_assert(sizeof(TTSharedHeader) == 64);
+
 class TTable {
-  std::vector<TTEntry> Data;
-  std::atomic<uint8_t> Age = 0;
+  /// Allocated with allocHuge() or following Shared,
+  /// clusters are zero when empty
+  TTCluster *Data = nullptr;
+  uint64_t NumClusters = 0;
+
+  /// Segment the table lives in when it's shared with other processes
+  TTSharedHeader *Shared = nullptr;
+
+  /// Number of searches so far modulo 64, in Shared when there is one
+  /// so every process ages the table
+  std::atomic<uint8_t> PrivateAge = 0;
+  std::atomic<uint8_t> *Age = &PrivateAge;
+
+  /// Nodes the pages of the table are spread over, empty to leave
+  /// them wherever they're first touched
+  std::vector<NumaNode> Interleave;
+
+  /// Counters of every search so far
+  TTStats Totals;
+  mutable std::mutex TotalsMutex;
 
 public:
+  /// Worth of a search of age in plies of depth when picking a victim
+  static constexpr int AGE_WEIGHT = 8;
+
   // Default at 16 MB
-  TTable() { resize(16); }
+  TTable() { resize(16, 1); }
 
-  void ageUp() {
-    // Has to fit into 6 bits
-    if (++Age > 63)
-      Age = 0;
+  ~TTable() { release(Data, NumClusters, Shared); }
+
+  TTable(const TTable &) = delete;
+  TTable &operator=(const TTable &) = delete;
+
+  /// Most clusters of the resized table an entry is copied to when
+  /// it can't tell which one the entry belongs to
+  static constexpr uint64_t MAX_COPIES = 4;
+
+  /// Current age, has to fit into 6 bits
+  [[nodiscard]] uint8_t age() const {
+    return Age->load(std::memory_order_relaxed) & 63;
   }
 
+  void ageUp() { Age->fetch_add(1, std::memory_order_relaxed); }
+
   // clang-format off
   [[nodiscard]] uint64_t index(uint64_t Hash) const {
     return static_cast<uint64_t>(
       (static_cast<__uint128_t>(Hash) *
-       static_cast<__uint128_t>(Data.size())) >> 64);
+       static_cast<__uint128_t>(NumClusters)) >> 64);
   }
   // clang-format on
 
+  /// Number of searches since the entry was stored
+  [[nodiscard]] int relativeAge(const TTEntry &Entry) const {
+    return (age() - Entry.age()) & 63;
+  }
+
   void storeEntry(uint64_t Hash, uint16_t BestMove, int16_t Score, int16_t Eval,
-                  Bound Bound, uint8_t Depth) {
-    TTEntry &PrevEntry = Data[index(Hash)];
+                  Bound Bound, uint8_t Depth, TTStats &Stats) {
+    TTCluster &Cluster = Data[index(Hash)];
+    const uint16_t Key = Hash;
+
+    // Reuse the entry of the same position or an empty one if there is one,
+    // otherwise replace the shallowest entry, older ones counting as shallower
+    int Victim = -1;
+    TTEntry PrevEntry;
+    uint64_t PrevData = 0;
+    bool SamePosition = false;
+
+    for (int i = 0; i < TTCluster::SIZE; ++i) {
+      const uint64_t EntryData = Cluster.data(i);
+      const TTEntry Entry(EntryData);
+
+      const bool Same = EntryData != 0 && Cluster.key(i, EntryData) == Key;
+      const bool Reuse = Same || EntryData == 0;
+
+      if (Victim == -1 || Reuse ||
+          Entry.Depth - AGE_WEIGHT * relativeAge(Entry) <
+              PrevEntry.Depth - AGE_WEIGHT * relativeAge(PrevEntry)) {
+        Victim = i;
+        PrevEntry = Entry;
+        PrevData = EntryData;
+        SamePosition = Same;
+      }
+
+      if (Reuse)
+        break;
+    }
 
     // Make sure the new entry isn't worse
     if (Bound != Bound::Exact &&       // Not exact PV
-        Hash == PrevEntry.Hash &&      // From same position
+        SamePosition &&                // From same position
         Depth < PrevEntry.Depth - 4 && // From much lower depth
-        Age == PrevEntry.age())        // From same search
+        age() == PrevEntry.age()) {    // From same search
+      if constexpr (TT_STATS_ENABLED)
+        ++Stats.Kept;
+
       return;
+    }
 
-    PrevEntry.Hash = Hash;
-    PrevEntry.BestMove = BestMove;
-    PrevEntry.Score = Score;
-    PrevEntry.Eval = Eval;
-    PrevEntry.Other = static_cast<uint8_t>(Bound) | (Age << 2);
-    PrevEntry.Depth = Depth;
+    if constexpr (TT_STATS_ENABLED) {
+      if (PrevData == 0)
+        ++Stats.Fills;
+      else if (SamePosition)
+        ++Stats.Updates;
+      else if (relativeAge(PrevEntry) == 0)
+        ++Stats.ByDepth;
+      else
+        ++Stats.ByAge;
+    }
+
+    Cluster.store(Victim, Hash,
+                  TTEntry(BestMove, Score, Eval, Bound, age(), Depth).pack());
   }
 
-  /// Probe for hash entry, return nothing if hash doesn't match
-  [[nodiscard]] const TTEntry *const probeEntry(uint64_t Hash) const {
-    const TTEntry &Entry = Data[index(Hash)];
-    return Entry.Hash == Hash ? &Entry : nullptr;
+  /// Probe for hash entry, return false if no entry of the cluster
+  /// matches the hash
+  [[nodiscard]] bool probeEntry(uint64_t Hash, TTEntry &Entry,
+                                TTStats &Stats) const {
+    const TTCluster &Cluster = Data[index(Hash)];
+    int Occupied = 0;
+
+    if constexpr (TT_STATS_ENABLED)
+      ++Stats.Probes;
+
+    for (int i = 0; i < TTCluster::SIZE; ++i) {
+      // Read the data once, the entry might be overwritten in between
+      const uint64_t EntryData = Cluster.data(i);
+
+      // Empty entries are all zero
+      if (EntryData != 0 &&
+          Cluster.key(i, EntryData) == static_cast<uint16_t>(Hash)) {
+        if constexpr (TT_STATS_ENABLED)
+          ++Stats.Hits;
+
+        Entry = TTEntry(EntryData);
+        return true;
+      }
+
+      Occupied += EntryData != 0;
+    }
+
+    if constexpr (TT_STATS_ENABLED)
+      Stats.Collisions += Occupied == TTCluster::SIZE;
+
+    return false;
   }
 
-  void prefetch(uint64_t Hash) const { __builtin_prefetch(&Data[index(Hash)]); }
+  /// Add the counters of a search thread, which counts on its own
+  /// to keep every probe from writing to a shared cache line
+  void addStats(const TTStats &Stats) {
+    std::lock_guard Lock(TotalsMutex);
+    Totals += Stats;
+  }
+
+  [[nodiscard]] TTStats stats() const {
+    std::lock_guard Lock(TotalsMutex);
+    return Totals;
+  }
+
+  /// Number of entries by their relative age, from the first clusters
+  /// of the table
+  [[nodiscard]] std::array<uint64_t, 64> ageHistogram() const;
 
-  void clear() { std::fill(Data.begin(), Data.end(), TTEntry()); }
+  void prefetch(uint64_t Hash) const { __builtin_prefetch(&Data[index(Hash)]); }
 
-  /// Resize transposition table to size in MB
-  void resize(uint64_t Size) {
-    const uint64_t HashSize = 0x100000 * Size;
-    const uint64_t numEntries = (HashSize / sizeof(TTEntry)) - 2;
-    Data.resize(numEntries);
-    Age.store(0, std::memory_order_relaxed);
-    clear();
+  /// Empty the table, split between the given number of threads
+  /// so each one touches its share of the pages first
+  void clear(int Threads) {
+    forEachSlice(Threads, [this](uint64_t Start, uint64_t End) {
+      std::memset(static_cast<void *>(Data + Start), 0,
+                  (End - Start) * sizeof(TTCluster));
+    });
   }
 
+  /// Resize transposition table to size in MB, keeping as many entries
+  /// as fit, see migrate()
+  void resize(uint64_t Size, int Threads);
+
+  /// Move the table into the POSIX shared memory segment of the given name,
+  /// made with the current size unless another process made it already,
+  /// in which case the sizes have to match.
+  /// An empty name moves it back into private memory. Every process using
+  /// the segment reads and writes the same entries, like search threads.
+  /// On failure the table is kept and the problem is described in Error
+  bool share(const std::string &Name, int Threads, std::string &Error);
+
+  [[nodiscard]] bool isShared() const { return Shared != nullptr; }
+
+  /// Spread the table evenly over the NUMA nodes, so no node serves every
+  /// probe, or go back to placing pages where they're first touched.
+  /// A shared table is left where it is
+  void setInterleaved(bool Enabled);
+
+  /// Write the table to a file, describe the problem in Error on failure
+  bool save(const std::string &Path, std::string &Error) const;
+
+  /// Read a table written by save() with the same Hash size, entry format
+  /// and Zobrist keys. On failure the table is left empty if it was
+  /// partially overwritten, the problem is described in Error
+  bool load(const std::string &Path, std::string &Error);
+
   // 0    => Empty hash table
   // 1000 => Full hash table
+  // Only entries of the current search count, older ones are
+  // as good as empty for replacement
   [[nodiscard]] int hashfull() {
     int Cnt = 0;
 
-    for (int i = 1; i <= 1000; ++i)
-      if (Data[i].Hash != 0)
+    for (int i = 0; i < 1000; ++i) {
+      const uint64_t EntryData =
+          Data[i / TTCluster::SIZE].data(i % TTCluster::SIZE);
+
+      if (EntryData != 0 && TTEntry(EntryData).age() == age())
         ++Cnt;
+    }
 
     return Cnt;
   }
+
+private:
+  /// Run Work(Start, End) on every slice of the clusters, one thread each
+  template <typename F> void forEachSlice(int Threads, F Work) {
+    std::vector<std::thread> Workers;
+
+    for (int i = 0; i < Threads; ++i)
+      Workers.emplace_back([this, &Work, i, Threads]() {
+        Work(NumClusters * i / Threads, NumClusters * (i + 1) / Threads);
+      });
+
+    for (std::thread &Worker : Workers)
+      Worker.join();
+  }
+
+  /// Allocate clusters for a private table, nullptr on failure
+  [[nodiscard]] TTCluster *allocate(uint64_t Clusters) const;
+
+  /// Switch to the given clusters, clear them and move the current
+  /// entries into them, then free the current ones
+  void replace(TTCluster *NewData, uint64_t NewClusters,
+               TTSharedHeader *NewShared, int Threads);
+
+  /// Free clusters from allocHuge() or unmap a shared segment
+  static void release(TTCluster *Data, uint64_t NumClusters,
+                      TTSharedHeader *Shared);
+
+  /// Move the entries of the old table belonging to clusters
+  /// [Start, End) of the current one
+  void migrate(const TTCluster *Old, uint64_t OldClusters, uint64_t Start,
+               uint64_t End);
+
+  /// Put the entry into the cluster if it's empty or worth more than
+  /// the worst entry, deeper and newer entries are worth more
+  void place(TTCluster &Cluster, uint16_t Key, uint64_t EntryData);
 };
 
 } // namespace pali
@@ -0,0 +1,145 @@
+#include "search/ThreadPool.h"
+
+#include "core/Numa.h"
+#include "core/Position.h"
+#include "nnue/Network.h"
+#include "search/SearchThread.h"
+
+#include <memory>
+#include <mutex>
+
+using namespace pali;
+
+ThreadPool::ThreadPool(std::atomic<bool> &Stopped, class TTable &TTable,
+                       class EvalCache &EvalCache)
+    : RootPos(STARTPOS), Stopped(Stopped), TTable(TTable),
+      EvalCache(EvalCache) {
+  resize(1);
+}
+
+void ThreadPool::resize(int Threads) {
+  wait();
+
+  {
+    std::lock_guard Lock(Mutex);
+    Exiting = true;
+  }
+  WakeUp.notify_all();
+
+  for (std::thread &Worker : Workers)
+    Worker.join();
+
+  Workers.clear();
+  Searchers.clear();
+  Exiting = false;
+
+  // Each thread fills its own slot, wait for all of them
+  Searchers.resize(Threads);
+  Running = Threads;
+
+  for (int i = 0; i < Threads; ++i)
+    Workers.emplace_back(&ThreadPool::idle, this, i, Generation);
+
+  wait();
+}
+
+void ThreadPool::start(const Position &Pos, const KeyHistory &History,
+                       const SearchLimits &Limits) {
+  wait();
+
+  {
+    std::lock_guard Lock(Mutex);
+
+    RootPos = Pos;
+    for (auto &Searcher : Searchers) {
+      Searcher->start(Limits);
+      Searcher->History = History;
+    }
+
+    Running = Searchers.size();
+    ++Generation;
+  }
+
+  WakeUp.notify_all();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock Lock(Mutex);
+  Done.wait(Lock, [this]() { return Running == 0; });
+}
+
+void ThreadPool::clear() {
+  wait();
+
+  for (auto &Searcher : Searchers)
+    Searcher->HTable.clear();
+}
+
+void ThreadPool::networkChanged() {
+  wait();
+
+  for (auto &Searcher : Searchers)
+    Searcher->Accumulators.clearRefreshTable();
+}
+
+int ThreadPool::setNuma(bool Enabled) {
+  wait();
+
+  Nodes = Enabled ? numaNodes() : std::vector<NumaNode>();
+  resize(Searchers.size());
+
+  return Nodes.size();
+}
+
+int ThreadPool::nodeOf(int Index) const {
+  if (Nodes.empty())
+    return -1;
+
+  // Consecutive threads share a node
+  return Index * Nodes.size() / Searchers.size();
+}
+
+void ThreadPool::idle(int Index, uint64_t First) {
+  const int Node = nodeOf(Index);
+
+  if (Node >= 0)
+    pinThread(Nodes[Node]);
+
+  // Memory touched first from the pinned thread is local to its node
+  useNNUE(Node >= 0 ? Nodes[Node].Id : -1);
+  Searchers[Index] =
+      std::make_unique<SearchThread>(Stopped, TTable, EvalCache);
+
+  SearchThread &Searcher = *Searchers[Index];
+  uint64_t Seen = First;
+
+  {
+    std::lock_guard Lock(Mutex);
+    if (--Running == 0)
+      Done.notify_all();
+  }
+
+  while (true) {
+    std::unique_lock Lock(Mutex);
+    WakeUp.wait(Lock, [this, Seen]() { return Exiting || Generation != Seen; });
+
+    if (Exiting)
+      return;
+
+    Seen = Generation;
+    Position Pos = RootPos;
+    Lock.unlock();
+
+    // The network might have changed since the last search
+    useNNUE(Node >= 0 ? Nodes[Node].Id : -1);
+
+    if (Index == 0)
+      Searcher.go<true>(Pos);
+    else
+      Searcher.go<false>(Pos);
+
+    Lock.lock();
+    if (--Running == 0)
+      Done.notify_all();
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "core/KeyHistory.h"
+#include "core/Numa.h"
+#include "core/Position.h"
+#include "search/EvalCache.h"
+#include "search/SearchThread.h"
+#include "search/TTable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pali {
+
+/// Search threads created once and parked between searches,
+/// each keeping its own search state from one search to the next.
+/// The first thread is the main one, it reports the search and stops
+/// the others when it's done.
+/// With NUMA on the threads are spread evenly over the nodes, each pinned
+/// to the CPUs of its node and using a copy of the network on that node
+class ThreadPool {
+  std::vector<std::unique_ptr<SearchThread>> Searchers;
+  std::vector<std::thread> Workers;
+
+  std::mutex Mutex;
+  std::condition_variable WakeUp;
+  std::condition_variable Done;
+
+  /// Bumped for every search, a worker searches when it sees a new one
+  uint64_t Generation = 0;
+  int Running = 0;
+  bool Exiting = false;
+
+  /// Nodes the threads are spread over, empty with NUMA off
+  std::vector<NumaNode> Nodes;
+
+  Position RootPos;
+
+  std::atomic<bool> &Stopped;
+  TTable &TTable;
+  EvalCache &EvalCache;
+
+public:
+  ThreadPool(std::atomic<bool> &Stopped, class TTable &TTable,
+             class EvalCache &EvalCache);
+
+  ~ThreadPool() { resize(0); }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// Wait for the current search, then replace the threads,
+  /// their search state starts over
+  void resize(int Threads);
+
+  /// Wake every thread to search the position,
+  /// History holds the hashes of the game that led to it
+  void start(const Position &Pos, const KeyHistory &History,
+             const SearchLimits &Limits);
+
+  /// Block until every thread is done searching
+  void wait();
+
+  /// Forget the histories, for a new game
+  void clear();
+
+  /// Recompute cached accumulators from the current network
+  void networkChanged();
+
+  /// Pin the threads to NUMA nodes or let them run anywhere,
+  /// return the number of nodes used
+  int setNuma(bool Enabled);
+
+private:
+  /// Loop of a worker thread, First is the generation it was created in.
+  /// The thread places itself and allocates its own search state first
+  void idle(int Index, uint64_t First);
+
+  /// NUMA node of the thread, -1 with NUMA off
+  [[nodiscard]] int nodeOf(int Index) const;
+};
+
+} // namespace pali
@@ -2,14 +2,24 @@
 
 #include "core/Move.h"
 #include "core/Position.h"
+#include "core/Util.h"
+#include "nnue/AccumulatorStack.h"
+#include "nnue/BatchEval.h"
+#include "nnue/Network.h"
+#include "search/EvalCache.h"
 #include "search/History.h"
 #include "search/SearchThread.h"
+#include "search/ThreadPool.h"
 #include "search/TTable.h"
+#include "uci/EvalBench.h"
 #include "uci/Perft.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <cstddef>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -17,21 +27,22 @@
 
 using namespace pali;
 
-std::thread MainThread;
-std::vector<std::thread> HelperThreads;
+std::thread PerftThread;
 
-std::vector<HTable> HelperHTables;
+void joinThreads(ThreadPool &ThreadPool) {
+  if (PerftThread.joinable())
+    PerftThread.join();
 
-void joinThreads() {
-  if (MainThread.joinable())
-    MainThread.join();
+  ThreadPool.wait();
+}
 
-  for (auto &Thread : HelperThreads)
-    if (Thread.joinable())
-      Thread.join();
+/// Join the parameters back together, paths may contain spaces
+std::string joinPath(const std::vector<std::string> &Params) {
+  std::string Path;
+  for (const std::string &Token : Params)
+    Path += (Path.empty() ? "" : " ") + Token;
 
-  HelperThreads.clear();
-  HelperHTables.clear();
+  return Path;
 }
 
 void pali::command::uci() {
@@ -41,24 +52,37 @@ void pali::command::uci() {
             << "option name Hash type spin default 16 min 1 max 262144\n"
             << "option name Threads type spin default 1 min 1 max 512\n"
             << "option name Clear Hash type button\n"
+            << "option name SharedHash type string default <empty>\n"
+            << "option name EvalCache type spin default 2 min 1 max 1024\n"
+            << "option name EvalFile type string default <empty>\n"
+            << "option name SharedNetwork type check default true\n"
+            << "option name NUMA type check default false\n"
             << "uciok\n";
 }
 
 void pali::command::isready() { std::cout << "readyok\n"; }
 
 void pali::command::ucinewgame(const std::vector<std::string> &Params,
-                               Position &RootPos, Options &Opt, TTable &TTable,
-                               HTable &HTable) {
+                               Position &RootPos, KeyHistory &History,
+                               Options &Opt, TTable &TTable,
+                               ThreadPool &ThreadPool) {
   RootPos = Position(STARTPOS);
-  TTable.clear();
-  HTable.clear();
+  History.clear();
+
+  // Other processes might still be searching with a shared table
+  if (!TTable.isShared())
+    TTable.clear(Opt.Threads);
+
+  ThreadPool.clear();
 }
 
 void pali::command::position(const std::vector<std::string> &Params,
-                             Position &RootPos) {
+                             Position &RootPos, KeyHistory &History) {
   for (auto It = Params.begin(); It < Params.end(); ++It) {
-    if (*It == "startpos")
+    if (*It == "startpos") {
       RootPos = Position(STARTPOS);
+      History.clear();
+    }
 
     else if (*It == "fen") {
       std::string Fen;
@@ -66,6 +90,7 @@ void pali::command::position(const std::vector<std::string> &Params,
         Fen += *It + " ";
 
       RootPos = Position(Fen);
+      History.clear();
       It--; // We might be on the token "moves"
     }
 
@@ -75,57 +100,147 @@ void pali::command::position(const std::vector<std::string> &Params,
         RootPos.genNoisy(Ml);
         RootPos.genQuiet(Ml);
 
-        for (Move Mv : Ml)
-          if (Mv.uciStr() == *It)
-            RootPos.makeMove(Mv);
+        StateInfo State;
+        for (Move Mv : Ml) {
+          if (Mv.uciStr() != *It)
+            continue;
+
+          History.push(RootPos.hash());
+          RootPos.makeMove(Mv, State);
+
+          // Nothing before a capture or pawn move can come back
+          if (RootPos.hmc() == 0)
+            History.clear();
+
+          // Make room, only the plies since then can repeat
+          else if (History.size() == KeyHistory::MAX_GAME_PLY)
+            History.keepLast(RootPos.hmc());
+        }
       }
     }
   }
 }
 
 void pali::command::setoption(const std::vector<std::string> &Params,
-                              Options &Opts, TTable &TTable) {
+                              Options &Opts, TTable &TTable,
+                              EvalCache &EvalCache, ThreadPool &ThreadPool) {
   // setoption name [option name] value [value]
   for (auto It = Params.begin(); It < Params.end(); ++It) {
     if (*It == "name") {
-      if (*(It + 1) == "Hash")
-        TTable.resize(std::stoi(*(It + 3)));
+      if (*(It + 1) == "Hash") {
+        joinThreads(ThreadPool);
+        TTable.resize(std::stoi(*(It + 3)), Opts.Threads);
+      }
+
+      else if (*(It + 1) == "EvalCache") {
+        // Searching threads still probe the old table
+        joinThreads(ThreadPool);
+        EvalCache.resize(std::stoi(*(It + 3)));
+      }
 
       else if (*(It + 1) == "MultiPV")
         Opts.MultiPV = std::stoi(*(It + 3));
 
-      else if (*(It + 1) == "Threads")
+      else if (*(It + 1) == "Threads") {
         Opts.Threads = std::stoi(*(It + 3));
+        ThreadPool.resize(Opts.Threads);
+      }
+
+      else if (*(It + 1) == "Clear") {
+        // Like ucinewgame, other processes might be searching with it
+        if (TTable.isShared())
+          std::cout << "info string the shared hash isn't cleared"
+                    << std::endl;
+        else
+          TTable.clear(Opts.Threads);
+      }
+
+      else if (*(It + 1) == "SharedNetwork") {
+        joinThreads(ThreadPool);
+        setSharedNNUE(*(It + 3) == "true");
+      }
+
+      else if (*(It + 1) == "NUMA") {
+        // The table and the networks move under the searching threads
+        joinThreads(ThreadPool);
+
+        const bool Enabled = *(It + 3) == "true";
+        const int Nodes = ThreadPool.setNuma(Enabled);
+        TTable.setInterleaved(Enabled);
+
+        if (Enabled)
+          std::cout << "info string threads spread over " << Nodes
+                    << " NUMA nodes" << std::endl;
+      }
+
+      else if (*(It + 1) == "SharedHash") {
+        std::string Name =
+            joinPath(std::vector<std::string>(It + 3, Params.end()));
+        if (Name == "<empty>")
+          Name.clear();
+
+        // Searching threads still probe the old table
+        joinThreads(ThreadPool);
+
+        std::string Error;
+        if (TTable.share(Name, Opts.Threads, Error))
+          std::cout << "info string using "
+                    << (Name.empty() ? "private hash" : "shared hash " + Name)
+                    << std::endl;
+        else
+          std::cout << "info string can't share hash: " << Error << std::endl;
+
+        return;
+      }
+
+      else if (*(It + 1) == "EvalFile") {
+        const std::string Path =
+            joinPath(std::vector<std::string>(It + 3, Params.end()));
+
+        // The threads can't switch networks mid search
+        joinThreads(ThreadPool);
+
+        std::string Error;
+        if (loadNNUE(Path, Error)) {
+          // Cached evaluations came from the old network
+          EvalCache.clear();
+          ThreadPool.networkChanged();
+
+          std::cout << "info string using network "
+                    << (Path.empty() || Path == "<empty>" ? "<embedded>" : Path)
+                    << std::endl;
+        } else
+          std::cout << "info string can't load network: " << Error
+                    << std::endl;
 
-      else if (*(It + 1) == "Clear")
-        TTable.clear();
+        return;
+      }
     }
   }
 }
 
 void pali::command::go(const std::vector<std::string> &Params,
-                       const Position &RootPos, Options &Opts,
-                       std::atomic<bool> &Stopped, TTable &TTable,
-                       HTable &HTable) {
+                       const Position &RootPos, const KeyHistory &History,
+                       Options &Opts, std::atomic<bool> &Stopped,
+                       ThreadPool &ThreadPool) {
   // Join any running thread
-  joinThreads();
+  joinThreads(ThreadPool);
 
   // Mark as not stopped
   Stopped = false;
 
-  int movestogo = 20;
-  int depth = 255;
-  uint64_t movetime = UINT64_MAX;
-  uint64_t nodes = UINT64_MAX;
   uint64_t wtime = UINT64_MAX;
   uint64_t btime = UINT64_MAX;
   uint64_t winc = 0;
   uint64_t binc = 0;
 
+  SearchLimits Limits;
+  Limits.MultiPV = Opts.MultiPV;
+
   for (auto It = Params.begin(); It < Params.end(); ++It) {
     if (*It == "perft") {
       int Depth = std::stoi(*(It + 1));
-      MainThread = std::thread(
+      PerftThread = std::thread(
           [&RootPos, &Stopped, Depth]() { perft(RootPos, Depth, Stopped); });
 
       return;
@@ -144,47 +259,150 @@ void pali::command::go(const std::vector<std::string> &Params,
       binc = std::stoi(*(It + 1));
 
     else if (*It == "depth")
-      depth = std::stoi(*(It + 1));
+      Limits.Depth = std::stoi(*(It + 1));
 
     else if (*It == "nodes")
-      nodes = std::stoi(*(It + 1));
+      Limits.Nodes = std::stoi(*(It + 1));
 
     else if (*It == "movetime")
-      movetime = std::stoi(*(It + 1));
+      Limits.MoveTime = std::stoi(*(It + 1));
 
     else if (*It == "movestogo")
-      movestogo = std::stoi(*(It + 1));
+      Limits.MovesToGo = std::stoi(*(It + 1));
   }
 
-  uint64_t Time = RootPos.stm().isWhite() ? wtime : btime;
-  uint64_t Inc = RootPos.stm().isWhite() ? winc : binc;
+  Limits.Time = RootPos.stm().isWhite() ? wtime : btime;
+  Limits.Inc = RootPos.stm().isWhite() ? winc : binc;
+
+  ThreadPool.start(RootPos, History, Limits);
+}
+
+void pali::command::evalbench(const std::vector<std::string> &Params,
+                              const Position &RootPos, ThreadPool &ThreadPool) {
+  joinThreads(ThreadPool);
+
+  int Iterations = Params.empty() ? 1000000 : std::stoi(Params[0]);
+
+  evalBench(RootPos, std::max(Iterations, 1));
+}
+
+void pali::command::evalbatch(const std::vector<std::string> &Params,
+                              ThreadPool &ThreadPool) {
+  joinThreads(ThreadPool);
 
-  SearchThread St = SearchThread(Stopped, Time, Inc, movetime, movestogo, depth,
-                                 nodes, Opts.MultiPV, TTable, HTable);
+  const std::string Path = joinPath(Params);
 
-  MainThread = std::thread(
-      [St](Position Pos) { SearchThread(St).go<true>(Pos); }, RootPos);
+  std::ifstream File(Path);
+  if (!File) {
+    std::cout << "info string can't open " << Path << std::endl;
+    return;
+  }
 
-  HelperThreads.reserve(Opts.Threads - 1);
-  HelperHTables.reserve(Opts.Threads - 1);
-  for (int i = 0; i < Opts.Threads - 1; ++i) {
-    SearchThread St =
-        SearchThread(Stopped, Time, Inc, movetime, movestogo, depth, nodes,
-                     Opts.MultiPV, TTable, HelperHTables[i]);
-    HelperHTables.push_back(HTable);
-    HelperThreads.emplace_back(std::thread(
-        [&](Position Pos) { SearchThread(St).go<false>(Pos); }, RootPos));
+  std::vector<Position> Positions;
+  std::string Fen;
+  while (std::getline(File, Fen)) {
+    // Accept quoted FENs like bench.txt
+    std::erase(Fen, '"');
+    if (Fen.find_first_not_of(" \t\r") != std::string::npos)
+      Positions.emplace_back(Fen);
   }
+
+  BatchEvaluator Evaluator;
+  std::vector<int> Evals(Positions.size());
+
+  uint64_t TimeStart = getTimeMs();
+  Evaluator.evaluate(Positions, Evals);
+  uint64_t Δt = std::max(getTimeMs() - TimeStart, (uint64_t)1);
+
+  // The same positions through the search's accumulator stack
+  AccumulatorStack Accumulators;
+  std::vector<int> Singles(Positions.size());
+
+  TimeStart = getTimeMs();
+  for (std::size_t i = 0; i < Positions.size(); ++i) {
+    Accumulators.reset(Positions[i]);
+    Singles[i] = Accumulators.evaluate(Positions[i]);
+  }
+  uint64_t ΔtSingle = std::max(getTimeMs() - TimeStart, (uint64_t)1);
+
+  for (int Eval : Evals)
+    std::cout << Eval << "\n";
+
+  std::cout << "info string evaluated " << Positions.size() << " positions in "
+            << Δt << " ms, " << Positions.size() * 1000 / Δt
+            << " positions/s, accumulator stack "
+            << Positions.size() * 1000 / ΔtSingle << " positions/s"
+            << std::endl;
+}
+
+void pali::command::stats(const EvalCache &EvalCache, const TTable &TTable) {
+  const uint64_t Hits = EvalCache.hits();
+  const uint64_t Probes = Hits + EvalCache.misses();
+
+  std::cout << "info string evalcache hits " << Hits << " misses "
+            << Probes - Hits << " hitrate "
+            << (Probes ? Hits * 1000 / Probes : 0) << " permille" << std::endl;
+
+  if constexpr (TT_STATS_ENABLED) {
+    const TTStats Stats = TTable.stats();
+
+    std::cout << "info string tt probes " << Stats.Probes << " hits "
+              << Stats.Hits << " cutoffs " << Stats.Cutoffs << " collisions "
+              << Stats.Collisions << " hitrate "
+              << (Stats.Probes ? Stats.Hits * 1000 / Stats.Probes : 0)
+              << " permille" << std::endl;
+
+    std::cout << "info string tt stores fill " << Stats.Fills << " update "
+              << Stats.Updates << " kept " << Stats.Kept << " bydepth "
+              << Stats.ByDepth << " byage " << Stats.ByAge << std::endl;
+  } else
+    std::cout << "info string tt counters need a build with -DTT_STATS=ON"
+              << std::endl;
+
+  // Searches ago the entries were stored
+  const auto Histogram = TTable.ageHistogram();
+
+  std::cout << "info string tt ages";
+  for (int Age = 0; Age < 64; ++Age)
+    if (Histogram[Age])
+      std::cout << " " << Age << ":" << Histogram[Age];
+  std::cout << std::endl;
+}
+
+void pali::command::savehash(const std::vector<std::string> &Params,
+                              const TTable &TTable, ThreadPool &ThreadPool) {
+  joinThreads(ThreadPool);
+
+  const std::string Path = joinPath(Params);
+
+  std::string Error;
+  if (TTable.save(Path, Error))
+    std::cout << "info string saved hash to " << Path << std::endl;
+  else
+    std::cout << "info string can't save hash: " << Error << std::endl;
+}
+
+void pali::command::loadhash(const std::vector<std::string> &Params,
+                              TTable &TTable, ThreadPool &ThreadPool) {
+  joinThreads(ThreadPool);
+
+  const std::string Path = joinPath(Params);
+
+  std::string Error;
+  if (TTable.load(Path, Error))
+    std::cout << "info string loaded hash from " << Path << std::endl;
+  else
+    std::cout << "info string can't load hash: " << Error << std::endl;
 }
 
-void pali::command::stop(std::atomic<bool> &Stopped) {
+void pali::command::stop(std::atomic<bool> &Stopped, ThreadPool &ThreadPool) {
   Stopped = true;
 
-  joinThreads();
+  joinThreads(ThreadPool);
 }
 
-void pali::command::exit() {
-  joinThreads();
+void pali::command::exit(ThreadPool &ThreadPool) {
+  joinThreads(ThreadPool);
 
   std::exit(0);
 }
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "core/KeyHistory.h"
 #include "core/Position.h"
-#include "search/History.h"
+#include "search/EvalCache.h"
 #include "search/TTable.h"
+#include "search/ThreadPool.h"
 
 #include <atomic>
 #include <string>
@@ -23,20 +25,43 @@ void uci();
 void isready();
 
 void ucinewgame(const std::vector<std::string> &Params, Position &RootPos,
-                Options &Opts, TTable &TTable, HTable &HTable);
+                KeyHistory &History, Options &Opts, TTable &TTable,
+                ThreadPool &ThreadPool);
 
-void position(const std::vector<std::string> &Params, Position &RootPos);
+void position(const std::vector<std::string> &Params, Position &RootPos,
+              KeyHistory &History);
 
 void setoption(const std::vector<std::string> &Params, Options &Opts,
-               TTable &TTable);
+               TTable &TTable, EvalCache &EvalCache, ThreadPool &ThreadPool);
 
 void go(const std::vector<std::string> &Params, const Position &RootPos,
-        Options &Opts, std::atomic<bool> &Stopped, TTable &TTable,
-        HTable &HTable);
+        const KeyHistory &History, Options &Opts, std::atomic<bool> &Stopped,
+        ThreadPool &ThreadPool);
 
-void stop(std::atomic<bool> &Stopped);
+/// Statically evaluate every FEN of a file, one per line,
+/// print the evaluations in order and the throughput
+void evalbatch(const std::vector<std::string> &Params, ThreadPool &ThreadPool);
 
-void exit();
+/// Print the eval cache and transposition table counters of every search
+/// so far, and the ages of the transposition table entries
+void stats(const EvalCache &EvalCache, const TTable &TTable);
+
+/// Compare the speed of the output layers, see evalBench()
+void evalbench(const std::vector<std::string> &Params, const Position &RootPos,
+               ThreadPool &ThreadPool);
+
+/// Write the transposition table to a file
+void savehash(const std::vector<std::string> &Params, const TTable &TTable,
+              ThreadPool &ThreadPool);
+
+/// Replace the transposition table with one written by savehash,
+/// Hash has to be set to the size it was saved with
+void loadhash(const std::vector<std::string> &Params, TTable &TTable,
+              ThreadPool &ThreadPool);
+
+void stop(std::atomic<bool> &Stopped, ThreadPool &ThreadPool);
+
+void exit(ThreadPool &ThreadPool);
 
 } // namespace command
 
@@ -0,0 +1,102 @@
+#include "EvalBench.h"
+
+#include "core/Color.h"
+#include "core/Piece.h"
+#include "core/Position.h"
+#include "core/Util.h"
+#include "nnue/Network.h"
+#include "nnue/Simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+
+using namespace pali;
+
+/// Accumulator of the position from one perspective, built from scratch
+Accumulator buildAccumulator(const Position &Pos, Color Perspective) {
+  Accumulator Acc = NNUE->InputBias;
+  const Square King = Pos.getBB(Piece::King, Perspective).lsb();
+
+  for (Color Col : {Color::White, Color::Black}) {
+    for (int Pc = Piece::Pawn; Pc <= Piece::King; ++Pc) {
+      Bitboard PiecesBB = Pos.getBB(static_cast<Piece::Type>(Pc), Col);
+
+      while (PiecesBB)
+        simd::add(Acc.Data.data(),
+                  inputWeights(featureIdx(Perspective, King, Col, Pc,
+                                          PiecesBB.takeLsb())));
+    }
+  }
+
+  return Acc;
+}
+
+/// Time Iterations evaluations and print the result
+template <typename Output>
+void timeOutput(const char *Name, const Output &Out, const Accumulator &Us,
+                const Accumulator &Them, int Bucket, int Iterations) {
+  uint64_t TimeStart = getTimeMs();
+
+  // Printing the sum keeps the evaluations from being optimised away
+  int64_t Sum = 0;
+  for (int i = 0; i < Iterations; ++i)
+    Sum += evaluateOutput(Out, Us, Them, Bucket);
+
+  uint64_t Δt = std::max(getTimeMs() - TimeStart, (uint64_t)1);
+
+  std::cout << Name << ": " << Δt * 1000000 / Iterations << " ns/eval, "
+            << Iterations * 1000 / Δt << " evals/s, sum " << Sum
+            << std::endl;
+}
+
+void pali::evalBench(const Position &Pos, int Iterations) {
+  const Accumulator Us = buildAccumulator(Pos, Pos.stm());
+  const Accumulator Them = buildAccumulator(Pos, Pos.stm().inverse());
+  const int Bucket = outputBucket(Pos.allBB().popcnt());
+
+  std::mt19937_64 Rng(0x123456789);
+  const auto random = [&Rng](int Max) {
+    return static_cast<int>(Rng() % (2 * Max + 1)) - Max;
+  };
+
+  auto Single = std::make_unique<OutputLayer>();
+  for (auto &Weights : Single->Weights)
+    for (Accumulator &Acc : Weights)
+      for (int16_t &W : Acc.Data)
+        W = random(126);
+
+  auto Dense = std::make_unique<DenseOutput>();
+  for (DenseLayers &Layers : *Dense) {
+    for (int8_t &W : Layers.L1Weights)
+      W = random(127);
+    for (int32_t &B : Layers.L1Bias)
+      B = random(QL1_IN * QL1);
+    for (float &W : Layers.L2Weights)
+      W = random(100) / 100.0f;
+    for (float &W : Layers.L3Weights)
+      W = random(100) / 100.0f;
+  }
+
+  // Sparsity of the first dense layer's input for this position
+  alignas(64) std::array<uint8_t, L1_SIZE> L1Input;
+  alignas(64) std::array<uint16_t, L1_SIZE / 4> NonZero;
+  simd::activateL1(Us.Data.data(), Them.Data.data(), L1Input.data());
+  const int Count = simd::findNonZero(L1Input.data(), NonZero.data());
+
+  std::cout << "kernels: " << simd::archName(simd::activeArch())
+            << "\nnetwork: " << (LAYERED ? "dense layers" : "single layer")
+            << "\nnon-zero input groups: " << Count << "/" << L1_SIZE / 4
+            << std::endl;
+
+  if constexpr (LAYERED) {
+    timeOutput("single layer", *Single, Us, Them, Bucket, Iterations);
+    timeOutput("dense layers", NNUE->Output, Us, Them, Bucket, Iterations);
+  } else {
+    timeOutput("single layer", NNUE->Output, Us, Them, Bucket, Iterations);
+    timeOutput("dense layers", *Dense, Us, Them, Bucket, Iterations);
+  }
+}
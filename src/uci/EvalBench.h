@@ -0,0 +1,13 @@
+#pragma once
+
+#include "core/Position.h"
+
+namespace pali {
+
+/// Time both kinds of output layers on the accumulators of Pos
+/// and print their throughput.
+/// The layer the network doesn't have gets random weights,
+/// which cost the same to evaluate as trained ones
+void evalBench(const Position &Pos, int Iterations);
+
+} // namespace pali
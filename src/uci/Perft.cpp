@@ -11,7 +11,7 @@
 
 using namespace pali;
 
-uint64_t subperft(const Position &Pos, int Depth, std::atomic<bool> &Stopped) {
+uint64_t subperft(Position &Pos, int Depth, std::atomic<bool> &Stopped) {
   if (Depth == 0 || Stopped)
     return 1;
 
@@ -21,13 +21,16 @@ uint64_t subperft(const Position &Pos, int Depth, std::atomic<bool> &Stopped) {
   Pos.genQuiet(Ml);
   Pos.genNoisy(Ml);
 
-  for (Move Mv : Ml) {
-    Position PosCopy = Pos;
+  // Every generated move is legal, no need to make the last ones
+  if (Depth == 1)
+    return Ml.size();
 
-    if (!PosCopy.makeMove(Mv))
-      continue;
+  StateInfo State;
 
-    Nodes += subperft(PosCopy, Depth - 1, Stopped);
+  for (Move Mv : Ml) {
+    Pos.makeMove(Mv, State);
+    Nodes += subperft(Pos, Depth - 1, Stopped);
+    Pos.unmakeMove(Mv, State);
   }
 
   return Nodes;
@@ -42,14 +45,16 @@ uint64_t pali::perft(const Position &Pos, int Depth,
   Pos.genQuiet(Ml);
   Pos.genNoisy(Ml);
 
+  // Moves are made and taken back on a single copy
+  Position Root = Pos;
+  StateInfo State;
+
   for (Move Mv : Ml) {
-    Position PosCopy = Pos;
     uint64_t CurrNodes = NodesTotal;
 
-    if (!PosCopy.makeMove(Mv))
-      continue;
-
-    NodesTotal += subperft(PosCopy, Depth - 1, Stopped);
+    Root.makeMove(Mv, State);
+    NodesTotal += subperft(Root, Depth - 1, Stopped);
+    Root.unmakeMove(Mv, State);
 
     if (Stopped)
       return 0;